@@ -0,0 +1,263 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// test for knewstuff-cli: installing from a mirror in a temporary directory
+
+#include <QtTest/QtTest>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QString>
+#include <QTcpServer>
+#include <QTemporaryDir>
+
+class testCli: public QObject
+{
+    Q_OBJECT
+private:
+    // write the index of the mirror, entry a in @p version, a web page h and a read-only file r
+    bool writeIndex(const QString &version);
+    bool writeFile(const QString &path, const QByteArray &data);
+    // run knewstuff-cli with @p arguments, the exit code or -1 if it did not finish
+    int run(const QStringList &arguments, QString *output = 0, QString *errors = 0);
+    // install entry @p id, for tests that start with an installed entry
+    bool install(const QString &id);
+
+    QTemporaryDir m_dir;
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void testUsage();
+    void testInstall();
+    void testListInstalled();
+    void testUpdate();
+    void testUninstall();
+    void testUninstallJson();
+    void testInstallReadOnlyPayload();
+    void testInstallHtmlPayload();
+    void testTimeout();
+};
+
+bool testCli::writeIndex(const QString &version)
+{
+    return writeFile(QStringLiteral("mirror/index.xml"),
+                     QStringLiteral("<knewstuff><stuff><id>a</id><name>Entry a</name><version>%1</version><payload>a.txt</payload></stuff>"
+                                    "<stuff><id>h</id><name>Entry h</name><version>1.0</version><payload>page.html</payload></stuff>"
+                                    "<stuff><id>r</id><name>Entry r</name><version>1.0</version><payload>r.txt</payload></stuff></knewstuff>")
+                     .arg(version).toUtf8());
+}
+
+bool testCli::writeFile(const QString &path, const QByteArray &data)
+{
+    const QString fileName = m_dir.path() + QLatin1Char('/') + path;
+    if (!QDir().mkpath(QFileInfo(fileName).path())) {
+        return false;
+    }
+    QFile file(fileName);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+int testCli::run(const QStringList &arguments, QString *output, QString *errors)
+{
+    QProcess process;
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert(QStringLiteral("XDG_CONFIG_HOME"), m_dir.path() + QStringLiteral("/config"));
+    environment.insert(QStringLiteral("XDG_DATA_HOME"), m_dir.path() + QStringLiteral("/data"));
+    environment.insert(QStringLiteral("XDG_CACHE_HOME"), m_dir.path() + QStringLiteral("/cache"));
+    process.setProcessEnvironment(environment);
+    process.start(QStringLiteral(KNEWSTUFF_CLI), arguments);
+    if (!process.waitForFinished(30000)) {
+        process.kill();
+        process.waitForFinished();
+        return -1;
+    }
+    if (output) {
+        *output = QString::fromUtf8(process.readAllStandardOutput());
+    }
+    if (errors) {
+        *errors = QString::fromUtf8(process.readAllStandardError());
+    }
+    return process.exitStatus() == QProcess::NormalExit ? process.exitCode() : -1;
+}
+
+bool testCli::install(const QString &id)
+{
+    return run(QStringList() << QStringLiteral("test.knsrc") << QStringLiteral("install") << id) == 0;
+}
+
+void testCli::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+    QVERIFY(writeFile(QStringLiteral("config/test.knsrc"),
+                      QStringLiteral("[KNewStuff3]\nProvidersUrl=%1\nAbsoluteInstallPath=%2\nUncompress=never\n")
+                      .arg(QUrl::fromLocalFile(m_dir.path() + QStringLiteral("/providers.xml")).toString(),
+                           m_dir.path() + QStringLiteral("/installed")).toUtf8()));
+    QVERIFY(writeFile(QStringLiteral("providers.xml"),
+                      QStringLiteral("<knewstuffproviders><provider type=\"directory\" path=\"%1\" index=\"index.xml\"><title>Mirror</title></provider></knewstuffproviders>")
+                      .arg(m_dir.path() + QStringLiteral("/mirror")).toUtf8()));
+    QVERIFY(writeFile(QStringLiteral("mirror/page.html"), "<!DOCTYPE html>\n<html><head><title>Download</title></head><body></body></html>\n"));
+    QVERIFY(writeFile(QStringLiteral("mirror/r.txt"), "read only"));
+    QVERIFY(QFile::setPermissions(m_dir.path() + QStringLiteral("/mirror/r.txt"),
+                                  QFileDevice::ReadOwner | QFileDevice::ReadGroup | QFileDevice::ReadOther));
+}
+
+void testCli::init()
+{
+    // every test starts with nothing installed and the mirror at version 1.0
+    foreach (const QString &path, QStringList() << QStringLiteral("/data") << QStringLiteral("/cache") << QStringLiteral("/installed")) {
+        QVERIFY(QDir(m_dir.path() + path).removeRecursively());
+    }
+    QVERIFY(QDir().mkpath(m_dir.path() + QStringLiteral("/installed")));
+    QVERIFY(writeFile(QStringLiteral("mirror/a.txt"), "content"));
+    QVERIFY(writeIndex(QStringLiteral("1.0")));
+}
+
+void testCli::testUsage()
+{
+    // update needs either --all or ids
+    QCOMPARE(run(QStringList() << QStringLiteral("test.knsrc") << QStringLiteral("update")), 1);
+    QCOMPARE(run(QStringList() << QStringLiteral("test.knsrc") << QStringLiteral("update") << QStringLiteral("--all") << QStringLiteral("a")), 1);
+    QCOMPARE(run(QStringList() << QStringLiteral("--timeout") << QStringLiteral("0") << QStringLiteral("test.knsrc") << QStringLiteral("list-installed")), 1);
+}
+
+void testCli::testInstall()
+{
+    QString output;
+    QCOMPARE(run(QStringList() << QStringLiteral("test.knsrc") << QStringLiteral("install") << QStringLiteral("a") << QStringLiteral("missing"), &output), 1);
+    QVERIFY2(output.contains(QStringLiteral("a\tEntry a\tinstalled\n")), qPrintable(output));
+    QVERIFY2(output.contains(QStringLiteral("missing\t\tnot found\n")), qPrintable(output));
+
+    QFile installed(m_dir.path() + QStringLiteral("/installed/a.txt"));
+    QVERIFY(installed.open(QIODevice::ReadOnly));
+    QCOMPARE(installed.readAll(), QByteArray("content"));
+    installed.close();
+
+    // the mirror file can be written, the installed file is a copy of it and changing it leaves the mirror alone
+    QVERIFY(installed.open(QIODevice::WriteOnly));
+    installed.write("changed");
+    installed.close();
+    QFile mirror(m_dir.path() + QStringLiteral("/mirror/a.txt"));
+    QVERIFY(mirror.open(QIODevice::ReadOnly));
+    QCOMPARE(mirror.readAll(), QByteArray("content"));
+}
+
+void testCli::testListInstalled()
+{
+    QVERIFY(install(QStringLiteral("a")));
+    QString output;
+    QCOMPARE(run(QStringList() << QStringLiteral("--json") << QStringLiteral("test.knsrc") << QStringLiteral("list-installed"), &output), 0);
+    const QJsonArray entries = QJsonDocument::fromJson(output.toUtf8()).array();
+    QCOMPARE(entries.size(), 1);
+    QCOMPARE(entries.at(0).toObject().value(QStringLiteral("id")).toString(), QStringLiteral("a"));
+    QCOMPARE(entries.at(0).toObject().value(QStringLiteral("status")).toString(), QStringLiteral("installed"));
+}
+
+void testCli::testUpdate()
+{
+    QVERIFY(install(QStringLiteral("a")));
+    // nothing to update, the check ends when the provider answered
+    QString output;
+    QElapsedTimer timer;
+    timer.start();
+    QCOMPARE(run(QStringList() << QStringLiteral("test.knsrc") << QStringLiteral("update") << QStringLiteral("--all"), &output), 0);
+    QVERIFY(output.isEmpty());
+    QVERIFY(timer.elapsed() < 20000);
+
+    QVERIFY(writeIndex(QStringLiteral("2.0")));
+    QCOMPARE(run(QStringList() << QStringLiteral("--json") << QStringLiteral("test.knsrc") << QStringLiteral("update") << QStringLiteral("a"), &output), 0);
+    QJsonParseError error;
+    const QJsonArray results = QJsonDocument::fromJson(output.toUtf8(), &error).array();
+    QVERIFY2(error.error == QJsonParseError::NoError, qPrintable(output));
+    QCOMPARE(results.size(), 1);
+    QCOMPARE(results.at(0).toObject().value(QStringLiteral("id")).toString(), QStringLiteral("a"));
+    QCOMPARE(results.at(0).toObject().value(QStringLiteral("result")).toString(), QStringLiteral("installed"));
+
+    QCOMPARE(run(QStringList() << QStringLiteral("--json") << QStringLiteral("test.knsrc") << QStringLiteral("list-installed"), &output), 0);
+    QCOMPARE(QJsonDocument::fromJson(output.toUtf8()).array().at(0).toObject().value(QStringLiteral("version")).toString(), QStringLiteral("2.0"));
+}
+
+void testCli::testUninstall()
+{
+    QVERIFY(install(QStringLiteral("a")));
+    QString output;
+    QCOMPARE(run(QStringList() << QStringLiteral("test.knsrc") << QStringLiteral("uninstall") << QStringLiteral("a"), &output), 0);
+    QVERIFY2(output.contains(QStringLiteral("a\tEntry a\tuninstalled\n")), qPrintable(output));
+    QVERIFY(!QFile::exists(m_dir.path() + QStringLiteral("/installed/a.txt")));
+}
+
+void testCli::testUninstallJson()
+{
+    QVERIFY(install(QStringLiteral("a")));
+    // uninstalling finishes at once, the results are still written as one document
+    QString output;
+    QCOMPARE(run(QStringList() << QStringLiteral("--json") << QStringLiteral("test.knsrc") << QStringLiteral("uninstall")
+                 << QStringLiteral("a") << QStringLiteral("missing"), &output), 1);
+    QJsonParseError error;
+    const QJsonArray results = QJsonDocument::fromJson(output.toUtf8(), &error).array();
+    QVERIFY2(error.error == QJsonParseError::NoError, qPrintable(output));
+    QCOMPARE(results.size(), 2);
+    QCOMPARE(results.at(0).toObject().value(QStringLiteral("id")).toString(), QStringLiteral("missing"));
+    QCOMPARE(results.at(0).toObject().value(QStringLiteral("result")).toString(), QStringLiteral("not found"));
+    QCOMPARE(results.at(1).toObject().value(QStringLiteral("id")).toString(), QStringLiteral("a"));
+    QCOMPARE(results.at(1).toObject().value(QStringLiteral("result")).toString(), QStringLiteral("uninstalled"));
+}
+
+void testCli::testInstallReadOnlyPayload()
+{
+    QString output;
+    QCOMPARE(run(QStringList() << QStringLiteral("test.knsrc") << QStringLiteral("install") << QStringLiteral("r"), &output), 0);
+    QVERIFY2(output.contains(QStringLiteral("r\tEntry r\tinstalled\n")), qPrintable(output));
+    QFile installed(m_dir.path() + QStringLiteral("/installed/r.txt"));
+    QVERIFY(installed.open(QIODevice::ReadOnly));
+    QCOMPARE(installed.readAll(), QByteArray("read only"));
+
+    // uninstalling removes the installed file, not the one on the mirror
+    QCOMPARE(run(QStringList() << QStringLiteral("test.knsrc") << QStringLiteral("uninstall") << QStringLiteral("r"), &output), 0);
+    QVERIFY(!QFile::exists(m_dir.path() + QStringLiteral("/installed/r.txt")));
+    QVERIFY(QFile::exists(m_dir.path() + QStringLiteral("/mirror/r.txt")));
+}
+
+void testCli::testInstallHtmlPayload()
+{
+    // a link to a web page instead of a download, the application does not accept html
+    QString output;
+    QCOMPARE(run(QStringList() << QStringLiteral("test.knsrc") << QStringLiteral("install") << QStringLiteral("h"), &output), 1);
+    QVERIFY2(output.contains(QStringLiteral("h\tEntry h\tfailed\n")), qPrintable(output));
+    QVERIFY(!QFile::exists(m_dir.path() + QStringLiteral("/installed/page.html")));
+}
+
+void testCli::testTimeout()
+{
+    // accepts connections but never answers
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    QVERIFY(writeFile(QStringLiteral("config/unreachable.knsrc"),
+                      QStringLiteral("[KNewStuff3]\nProvidersUrl=http://127.0.0.1:%1/providers.xml\nAbsoluteInstallPath=%2\n")
+                      .arg(server.serverPort()).arg(m_dir.path() + QStringLiteral("/installed")).toUtf8()));
+
+    QString output;
+    QString errors;
+    QCOMPARE(run(QStringList() << QStringLiteral("--timeout") << QStringLiteral("2") << QStringLiteral("unreachable.knsrc")
+                 << QStringLiteral("install") << QStringLiteral("a"), &output, &errors), 1);
+    QVERIFY2(output.contains(QStringLiteral("a\t\ttimed out\n")), qPrintable(output));
+    QVERIFY2(errors.contains(QStringLiteral("did not answer in time")), qPrintable(errors));
+}
+
+QTEST_GUILESS_MAIN(testCli)
+#include "knewstuffclitest.moc"
@@ -0,0 +1,152 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test for merging provider data into the entries a provider knows
+
+#include <QtTest/QtTest>
+#include <QString>
+
+#include "../src/core/entrystore_p.h"
+
+using namespace KNS3;
+
+class testEntryStore: public QObject
+{
+    Q_OBJECT
+private:
+    EntryInternal createEntry(const QString &id, const QString &version, const QDate &releaseDate, Entry::Status status);
+private Q_SLOTS:
+    void testNewEntry();
+    void testDownloadableEntry();
+    void testInstalledEntry();
+    void testUpdateableEntry();
+    void testRepeatedMerge();
+    void testOrder();
+};
+
+EntryInternal testEntryStore::createEntry(const QString &id, const QString &version, const QDate &releaseDate, Entry::Status status)
+{
+    EntryInternal entry;
+    entry.setUniqueId(id);
+    entry.setProviderId(QStringLiteral("provider"));
+    entry.setName(QStringLiteral("Entry ") + id);
+    entry.setVersion(version);
+    entry.setReleaseDate(releaseDate);
+    entry.setStatus(status);
+    return entry;
+}
+
+void testEntryStore::testNewEntry()
+{
+    EntryStore store;
+    const EntryInternal fresh = createEntry(QStringLiteral("1"), QStringLiteral("1.0"), QDate(2016, 1, 1), Entry::Downloadable);
+
+    const EntryInternal merged = store.merge(fresh);
+    QCOMPARE(merged.status(), Entry::Downloadable);
+    QCOMPARE(store.size(), 1);
+    QCOMPARE(store.entry(QStringLiteral("1")).version(), QStringLiteral("1.0"));
+    QVERIFY(!store.entry(QStringLiteral("2")).isValid());
+}
+
+void testEntryStore::testDownloadableEntry()
+{
+    EntryStore store;
+    store.merge(createEntry(QStringLiteral("1"), QStringLiteral("1.0"), QDate(2016, 1, 1), Entry::Downloadable));
+
+    // the provider offers a newer version of an entry that is not installed
+    EntryInternal fresh = createEntry(QStringLiteral("1"), QStringLiteral("2.0"), QDate(2016, 2, 1), Entry::Downloadable);
+    fresh.setName(QStringLiteral("New name"));
+    const EntryInternal merged = store.merge(fresh);
+    QCOMPARE(merged.status(), Entry::Downloadable);
+    QCOMPARE(merged.version(), QStringLiteral("2.0"));
+    QCOMPARE(merged.name(), QStringLiteral("New name"));
+    QCOMPARE(store.size(), 1);
+}
+
+void testEntryStore::testInstalledEntry()
+{
+    EntryStore store;
+    EntryInternal installed = createEntry(QStringLiteral("1"), QStringLiteral("1.0"), QDate(2016, 1, 1), Entry::Installed);
+    installed.setInstalledFiles(QStringList() << QStringLiteral("/some/file"));
+    store.insert(EntryInternal::List() << installed);
+
+    const EntryInternal merged = store.merge(createEntry(QStringLiteral("1"), QStringLiteral("1.0"), QDate(2016, 1, 1), Entry::Downloadable));
+    QCOMPARE(merged.status(), Entry::Installed);
+    QCOMPARE(merged.installedFiles(), QStringList() << QStringLiteral("/some/file"));
+}
+
+void testEntryStore::testUpdateableEntry()
+{
+    EntryStore store;
+    store.insert(EntryInternal::List() << createEntry(QStringLiteral("1"), QStringLiteral("1.0"), QDate(2016, 1, 1), Entry::Installed));
+
+    const EntryInternal merged = store.merge(createEntry(QStringLiteral("1"), QStringLiteral("2.0"), QDate(2016, 2, 1), Entry::Downloadable));
+    QCOMPARE(merged.status(), Entry::Updateable);
+    QCOMPARE(merged.version(), QStringLiteral("1.0"));
+    QCOMPARE(merged.releaseDate(), QDate(2016, 1, 1));
+    QCOMPARE(merged.updateVersion(), QStringLiteral("2.0"));
+    QCOMPARE(merged.updateReleaseDate(), QDate(2016, 2, 1));
+
+    // only the release date changed
+    store.insert(EntryInternal::List() << createEntry(QStringLiteral("2"), QStringLiteral("1.0"), QDate(2016, 1, 1), Entry::Installed));
+    QCOMPARE(store.merge(createEntry(QStringLiteral("2"), QStringLiteral("1.0"), QDate(2016, 3, 1), Entry::Downloadable)).status(), Entry::Updateable);
+
+    // a feed without release dates does not make an entry updateable
+    store.insert(EntryInternal::List() << createEntry(QStringLiteral("3"), QStringLiteral("1.0"), QDate(2016, 1, 1), Entry::Installed));
+    QCOMPARE(store.merge(createEntry(QStringLiteral("3"), QStringLiteral("1.0"), QDate(), Entry::Downloadable)).status(), Entry::Installed);
+
+    // only the checksum changed
+    EntryInternal installed = createEntry(QStringLiteral("4"), QStringLiteral("1.0"), QDate(), Entry::Installed);
+    installed.setChecksum(QStringLiteral("old"));
+    store.insert(EntryInternal::List() << installed);
+    EntryInternal fresh = createEntry(QStringLiteral("4"), QStringLiteral("1.0"), QDate(), Entry::Downloadable);
+    fresh.setChecksum(QStringLiteral("old"));
+    QCOMPARE(store.merge(fresh).status(), Entry::Installed);
+    fresh.setChecksum(QStringLiteral("new"));
+    QCOMPARE(store.merge(fresh).status(), Entry::Updateable);
+}
+
+void testEntryStore::testRepeatedMerge()
+{
+    EntryStore store;
+    store.insert(EntryInternal::List() << createEntry(QStringLiteral("1"), QStringLiteral("1.0"), QDate(2016, 1, 1), Entry::Installed));
+    store.merge(createEntry(QStringLiteral("1"), QStringLiteral("2.0"), QDate(2016, 2, 1), Entry::Downloadable));
+
+    // loading the feed again still compares with the installed version
+    const EntryInternal merged = store.merge(createEntry(QStringLiteral("1"), QStringLiteral("3.0"), QDate(2016, 3, 1), Entry::Downloadable));
+    QCOMPARE(merged.status(), Entry::Updateable);
+    QCOMPARE(merged.version(), QStringLiteral("1.0"));
+    QCOMPARE(merged.updateVersion(), QStringLiteral("3.0"));
+    QCOMPARE(store.size(), 1);
+}
+
+void testEntryStore::testOrder()
+{
+    EntryStore store;
+    store.merge(createEntry(QStringLiteral("b"), QStringLiteral("1.0"), QDate(), Entry::Downloadable));
+    store.merge(createEntry(QStringLiteral("a"), QStringLiteral("1.0"), QDate(), Entry::Downloadable));
+    store.merge(createEntry(QStringLiteral("b"), QStringLiteral("2.0"), QDate(), Entry::Downloadable));
+
+    const EntryInternal::List entries = store.entries();
+    QCOMPARE(entries.size(), 2);
+    QCOMPARE(entries.at(0).uniqueId(), QStringLiteral("b"));
+    QCOMPARE(entries.at(0).version(), QStringLiteral("2.0"));
+    QCOMPARE(entries.at(1).uniqueId(), QStringLiteral("a"));
+}
+
+QTEST_GUILESS_MAIN(testEntryStore)
+#include "knewstuffentrystoretest.moc"
@@ -0,0 +1,232 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test for splitting feeds into chunks while they arrive
+
+#include <QtTest/QtTest>
+#include <QString>
+
+#include "../src/core/feedparser_p.h"
+
+using namespace KNS3;
+
+class testFeedParser: public QObject
+{
+    Q_OBJECT
+private:
+    static QByteArray stuff(int id);
+    // a feed with the entries 0 to @p count - 1
+    static QByteArray feed(int count);
+    static QStringList ids(int count);
+    // parse @p document, handed to the parser in pieces of @p pieceSize bytes
+    bool parse(const QByteArray &document, int pieceSize, QStringList *ids = 0, QDomDocument *skeleton = 0);
+
+private Q_SLOTS:
+    void testWholeDocument();
+    void testByteByByte();
+    void testChunkBoundary_data();
+    void testChunkBoundary();
+    void testCommentsAndCdata();
+    void testQuotedGreaterThan();
+    void testDoctype();
+    void testSelfClosingRoot();
+    void testTruncated_data();
+    void testTruncated();
+};
+
+QByteArray testFeedParser::stuff(int id)
+{
+    return QStringLiteral("<stuff category=\"c\"><id>%1</id><name>Entry %1</name><summary>Summary of entry %1</summary></stuff>\n")
+           .arg(id).toUtf8();
+}
+
+QByteArray testFeedParser::feed(int count)
+{
+    QByteArray document = "<?xml version=\"1.0\"?>\n<knewstuff generation=\"1\">\n";
+    for (int i = 0; i < count; ++i) {
+        document += stuff(i);
+    }
+    return document + "</knewstuff>\n";
+}
+
+QStringList testFeedParser::ids(int count)
+{
+    QStringList result;
+    for (int i = 0; i < count; ++i) {
+        result.append(QString::number(i));
+    }
+    return result;
+}
+
+bool testFeedParser::parse(const QByteArray &document, int pieceSize, QStringList *ids, QDomDocument *skeleton)
+{
+    FeedParser parser;
+    QStringList parsed;
+    bool finished = false;
+    bool failed = false;
+    connect(&parser, &FeedParser::entriesParsed, this, [&parsed](const EntryInternal::List &entries) {
+        foreach (const EntryInternal &entry, entries) {
+            parsed.append(entry.uniqueId());
+        }
+    });
+    connect(&parser, &FeedParser::parsingFinished, this, [&finished]() {
+        finished = true;
+    });
+    connect(&parser, &FeedParser::parsingFailed, this, [&failed]() {
+        failed = true;
+    });
+
+    for (int pos = 0; pos < document.size() && !failed; pos += pieceSize) {
+        parser.addData(document.mid(pos, pieceSize));
+    }
+    parser.finish();
+    QElapsedTimer timer;
+    timer.start();
+    while (!finished && !failed && timer.elapsed() < 10000) {
+        QTest::qWait(10);
+    }
+
+    if (ids) {
+        *ids = parsed;
+    }
+    if (skeleton) {
+        *skeleton = parser.documentSkeleton();
+    }
+    return finished && !failed;
+}
+
+void testFeedParser::testWholeDocument()
+{
+    QStringList parsed;
+    QDomDocument skeleton;
+    QVERIFY(parse(feed(3), INT_MAX, &parsed, &skeleton));
+    QCOMPARE(parsed, ids(3));
+    QCOMPARE(skeleton.documentElement().tagName(), QStringLiteral("knewstuff"));
+    QCOMPARE(skeleton.documentElement().attribute(QStringLiteral("generation")), QStringLiteral("1"));
+    QVERIFY(!skeleton.documentElement().hasChildNodes());
+}
+
+void testFeedParser::testByteByByte()
+{
+    QStringList parsed;
+    QVERIFY(parse(feed(20), 1, &parsed));
+    QCOMPARE(parsed, ids(20));
+}
+
+void testFeedParser::testChunkBoundary_data()
+{
+    QTest::addColumn<int>("pieceSize");
+
+    // the first chunk is dispatched once 32 KiB of complete entries arrived
+    QTest::newRow("below the first chunk") << 32 * 1024 - 1;
+    QTest::newRow("first chunk") << 32 * 1024;
+    QTest::newRow("above the first chunk") << 32 * 1024 + 1;
+    QTest::newRow("small pieces") << 1000;
+    QTest::newRow("odd pieces") << 4093;
+}
+
+void testFeedParser::testChunkBoundary()
+{
+    QFETCH(int, pieceSize);
+
+    // several chunks of growing size
+    const QByteArray document = feed(3000);
+    QVERIFY(document.size() > 4 * 32 * 1024);
+    QStringList parsed;
+    QVERIFY(parse(document, pieceSize, &parsed));
+    QCOMPARE(parsed, ids(3000));
+}
+
+void testFeedParser::testCommentsAndCdata()
+{
+    const QByteArray document = "<knewstuff><!-- <stuff><id>x</id></stuff> </knewstuff> -->"
+                                + stuff(0)
+                                + "<stuff><id>1</id><summary><![CDATA[ </stuff></knewstuff> <stuff> ]]></summary></stuff>"
+                                + "<!-- > -->" + stuff(2) + "</knewstuff>";
+    foreach (int pieceSize, QList<int>() << 1 << 7 << INT_MAX) {
+        QStringList parsed;
+        QVERIFY(parse(document, pieceSize, &parsed));
+        QCOMPARE(parsed, ids(3));
+    }
+}
+
+void testFeedParser::testQuotedGreaterThan()
+{
+    const QByteArray document = "<knewstuff title=\"a > b\"><stuff category='x>y'><id>0</id><name lang=\"&gt;\">a</name></stuff>"
+                                "<stuff category=\"/>\"><id>1</id></stuff></knewstuff>";
+    foreach (int pieceSize, QList<int>() << 1 << INT_MAX) {
+        QStringList parsed;
+        QDomDocument skeleton;
+        QVERIFY(parse(document, pieceSize, &parsed, &skeleton));
+        QCOMPARE(parsed, ids(2));
+        QCOMPARE(skeleton.documentElement().attribute(QStringLiteral("title")), QStringLiteral("a > b"));
+    }
+}
+
+void testFeedParser::testDoctype()
+{
+    const QByteArray document = "<?xml version=\"1.0\"?>\n"
+                                "<!DOCTYPE knewstuff [\n"
+                                "  <!ELEMENT knewstuff (stuff*)>\n"
+                                "  <!ATTLIST knewstuff generation CDATA \"\">\n"
+                                "]>\n"
+                                "<knewstuff generation=\"4\">" + stuff(0) + stuff(1) + "</knewstuff>";
+    foreach (int pieceSize, QList<int>() << 1 << 5 << INT_MAX) {
+        QStringList parsed;
+        QDomDocument skeleton;
+        QVERIFY(parse(document, pieceSize, &parsed, &skeleton));
+        QCOMPARE(parsed, ids(2));
+        QCOMPARE(skeleton.documentElement().attribute(QStringLiteral("generation")), QStringLiteral("4"));
+    }
+}
+
+void testFeedParser::testSelfClosingRoot()
+{
+    foreach (int pieceSize, QList<int>() << 1 << INT_MAX) {
+        QStringList parsed;
+        QDomDocument skeleton;
+        QVERIFY(parse("<?xml version=\"1.0\"?><knewstuff generation=\"7\"/>\n", pieceSize, &parsed, &skeleton));
+        QVERIFY(parsed.isEmpty());
+        QCOMPARE(skeleton.documentElement().tagName(), QStringLiteral("knewstuff"));
+        QCOMPARE(skeleton.documentElement().attribute(QStringLiteral("generation")), QStringLiteral("7"));
+    }
+}
+
+void testFeedParser::testTruncated_data()
+{
+    QTest::addColumn<QByteArray>("document");
+
+    const QByteArray document = feed(3);
+    QTest::newRow("empty") << QByteArray();
+    QTest::newRow("no document element") << QByteArray("<?xml version=\"1.0\"?>");
+    QTest::newRow("in an entry") << document.left(document.indexOf("</stuff>"));
+    QTest::newRow("in a tag") << document.left(document.indexOf("<name") + 3);
+    QTest::newRow("in a comment") << QByteArray("<knewstuff>" + stuff(0) + "<!-- </knewstuff>");
+    QTest::newRow("unclosed document element") << document.left(document.lastIndexOf("</knewstuff>"));
+}
+
+void testFeedParser::testTruncated()
+{
+    QFETCH(QByteArray, document);
+
+    foreach (int pieceSize, QList<int>() << 1 << INT_MAX) {
+        QVERIFY(!parse(document, pieceSize));
+    }
+}
+
+QTEST_GUILESS_MAIN(testFeedParser)
+#include "knewstufffeedparsertest.moc"
@@ -0,0 +1,149 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test for storing installed entries: the registry file, its journal and the stream operators
+
+#include <QtTest/QtTest>
+#include <QString>
+#include <QTemporaryDir>
+
+#include "../src/core/registryfile_p.h"
+#include "../src/core/registryjournal_p.h"
+
+using namespace KNS3;
+
+class testRegistry: public QObject
+{
+    Q_OBJECT
+private:
+    EntryInternal createEntry(const QString &id);
+    void compareEntries(const EntryInternal &read, const EntryInternal &written);
+private Q_SLOTS:
+    void testStreamOperators();
+    void testRegistryFile();
+    void testJournal();
+};
+
+EntryInternal testRegistry::createEntry(const QString &id)
+{
+    EntryInternal entry;
+    entry.setProviderId(QStringLiteral("provider"));
+    entry.setUniqueId(id);
+    entry.setName(QStringLiteral("Entry ") + id);
+    entry.setCategory(QStringLiteral("Category"));
+    Author author;
+    author.setName(QStringLiteral("Author"));
+    author.setEmail(QStringLiteral("author@example.org"));
+    entry.setAuthor(author);
+    entry.setLicense(QStringLiteral("GPL"));
+    entry.setVersion(QStringLiteral("1.0"));
+    entry.setReleaseDate(QDate(2016, 1, 1));
+    entry.setSummary(QStringLiteral("Summary"));
+    entry.setPayload(QStringLiteral("http://example.org/") + id);
+    entry.setChecksum(QStringLiteral("d41d8cd98f00b204e9800998ecf8427e"));
+    entry.setSignature(QStringLiteral("-----BEGIN PGP SIGNATURE-----"));
+    entry.setRating(80);
+    entry.setDownloadCount(12);
+    entry.setStatus(Entry::Installed);
+    entry.setInstalledFiles(QStringList() << QStringLiteral("/some/file"));
+    return entry;
+}
+
+void testRegistry::compareEntries(const EntryInternal &read, const EntryInternal &written)
+{
+    QCOMPARE(read.providerId(), written.providerId());
+    QCOMPARE(read.uniqueId(), written.uniqueId());
+    QCOMPARE(read.name(), written.name());
+    QCOMPARE(read.author().name(), written.author().name());
+    QCOMPARE(read.version(), written.version());
+    QCOMPARE(read.releaseDate(), written.releaseDate());
+    QCOMPARE(read.payload(), written.payload());
+    QCOMPARE(read.checksum(), written.checksum());
+    QCOMPARE(read.signature(), written.signature());
+    QCOMPARE(read.status(), written.status());
+    QCOMPARE(read.installedFiles(), written.installedFiles());
+}
+
+void testRegistry::testStreamOperators()
+{
+    const EntryInternal written = createEntry(QStringLiteral("1"));
+    QByteArray data;
+    {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_5);
+        stream << written;
+    }
+
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_5);
+    EntryInternal read;
+    stream >> read;
+    QCOMPARE(stream.status(), QDataStream::Ok);
+    QVERIFY(stream.atEnd());
+    compareEntries(read, written);
+    QCOMPARE(read.rating(), written.rating());
+    QCOMPARE(read.downloadCount(), written.downloadCount());
+}
+
+void testRegistry::testRegistryFile()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.path() + QStringLiteral("/test.knsregistry.bin");
+
+    EntryInternal unsignedEntry = createEntry(QStringLiteral("2"));
+    unsignedEntry.setChecksum(QString());
+    unsignedEntry.setSignature(QString());
+    const EntryInternal::List written = EntryInternal::List() << createEntry(QStringLiteral("1")) << unsignedEntry;
+    QVERIFY(RegistryFile::write(fileName, RegistryFile::encode(written)));
+
+    RegistryFile registry(fileName);
+    QVERIFY(registry.open());
+    QCOMPARE(registry.providerIds(), QStringList() << QStringLiteral("provider"));
+    const EntryInternal::List read = registry.entries(QStringLiteral("provider"));
+    QCOMPARE(read.size(), 2);
+    compareEntries(read.at(0), written.at(0));
+    compareEntries(read.at(1), written.at(1));
+}
+
+void testRegistry::testJournal()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.path() + QStringLiteral("/test.knsregistry.bin.journal");
+
+    const EntryInternal installed = createEntry(QStringLiteral("1"));
+    EntryInternal removed = createEntry(QStringLiteral("2"));
+    removed.setStatus(Entry::Deleted);
+    {
+        RegistryJournal journal(fileName);
+        QVERIFY(journal.append(RegistryJournal::record(installed)));
+        QVERIFY(journal.append(RegistryJournal::record(removed)));
+        QCOMPARE(journal.recordCount(), 2);
+    }
+
+    RegistryJournal journal(fileName);
+    const QList<RegistryJournal::Record> records = journal.replay();
+    QCOMPARE(records.size(), 2);
+    QCOMPARE(records.at(0).operation, RegistryJournal::Put);
+    compareEntries(records.at(0).entry, installed);
+    QCOMPARE(records.at(1).operation, RegistryJournal::Remove);
+    QCOMPARE(records.at(1).entry.uniqueId(), removed.uniqueId());
+}
+
+QTEST_GUILESS_MAIN(testRegistry)
+#include "knewstuffregistrytest.moc"
@@ -0,0 +1,187 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test for the trigram index, it has to find what scanning all entries finds
+
+#include <QtTest/QtTest>
+#include <QString>
+
+#include "../src/core/searchindex_p.h"
+
+using namespace KNS3;
+
+class testSearchIndex: public QObject
+{
+    Q_OBJECT
+private:
+    static EntryInternal createEntry(int id, int revision);
+    static QStringList terms();
+    // "id name" of the entries, sorted
+    static QStringList describe(const QSet<EntryInternal> &entries);
+    // compare searching the index with scanning @p entries for all terms
+    void compareWithScan(const SearchIndex &index, const QHash<QString, EntryInternal> &entries);
+
+private Q_SLOTS:
+    void testSearch();
+    void testReplace();
+    void testRemove();
+    void testRebuild();
+    void testClear();
+};
+
+EntryInternal testSearchIndex::createEntry(int id, int revision)
+{
+    static const char *const words[] = { "wallpaper", "Theme", "ICON", "dark", "Ärger", "plasma", "Sonne", "mond" };
+    const int count = sizeof(words) / sizeof(words[0]);
+
+    EntryInternal entry;
+    entry.setProviderId(QStringLiteral("provider"));
+    entry.setUniqueId(QString::number(id));
+    entry.setName(QStringLiteral("Entry %1 %2").arg(id).arg(QString::fromUtf8(words[(id + revision) % count])));
+    entry.setSummary(QStringLiteral("A %1 %2, revision %3").arg(QString::fromUtf8(words[(id * 3 + revision) % count]))
+                     .arg(QString::fromUtf8(words[(id * 5) % count])).arg(revision));
+    Author author;
+    author.setName(id % 4 == 0 ? QString() : QStringLiteral("Author %1").arg(QString::fromUtf8(words[(id + 2 * revision) % count])));
+    entry.setAuthor(author);
+    return entry;
+}
+
+QStringList testSearchIndex::terms()
+{
+    return QStringList() << QString() << QStringLiteral("a") << QStringLiteral("en") << QStringLiteral("ent")
+           << QStringLiteral("ENTRY 1") << QStringLiteral("entry 12 ") << QStringLiteral("theme") << QStringLiteral("Icon")
+           << QStringLiteral("ärger") << QStringLiteral("ÄRGER") << QStringLiteral("revision 2") << QStringLiteral("author")
+           << QStringLiteral("sonne, ") << QStringLiteral("mond\nA") << QStringLiteral("  ") << QStringLiteral("xyz");
+}
+
+QStringList testSearchIndex::describe(const QSet<EntryInternal> &entries)
+{
+    QStringList result;
+    foreach (const EntryInternal &entry, entries) {
+        result.append(entry.uniqueId() + QLatin1Char(' ') + entry.name());
+    }
+    result.sort();
+    return result;
+}
+
+void testSearchIndex::compareWithScan(const SearchIndex &index, const QHash<QString, EntryInternal> &entries)
+{
+    QCOMPARE(index.size(), entries.size());
+    foreach (const QString &term, terms()) {
+        QSet<EntryInternal> scanned;
+        foreach (const EntryInternal &entry, entries) {
+            if (SearchIndex::matches(entry, term)) {
+                scanned.insert(entry);
+            }
+        }
+        QCOMPARE(describe(index.search(term)), describe(scanned));
+    }
+}
+
+void testSearchIndex::testSearch()
+{
+    SearchIndex index;
+    QHash<QString, EntryInternal> entries;
+    for (int id = 0; id < 100; ++id) {
+        const EntryInternal entry = createEntry(id, 0);
+        index.insert(entry);
+        entries.insert(entry.uniqueId(), entry);
+    }
+    compareWithScan(index, entries);
+    QVERIFY(!index.search(QStringLiteral("wallpaper")).isEmpty());
+    QVERIFY(index.search(QStringLiteral("xyz")).isEmpty());
+}
+
+void testSearchIndex::testReplace()
+{
+    SearchIndex index;
+    QHash<QString, EntryInternal> entries;
+    for (int id = 0; id < 50; ++id) {
+        index.insert(createEntry(id, 0));
+    }
+    // a new version of every other entry, found by its new fields only
+    for (int id = 0; id < 50; ++id) {
+        const EntryInternal entry = createEntry(id, id % 2);
+        index.insert(entry);
+        entries.insert(entry.uniqueId(), entry);
+    }
+    compareWithScan(index, entries);
+    QCOMPARE(describe(index.search(QStringLiteral("revision 0"))).size(), 25);
+}
+
+void testSearchIndex::testRemove()
+{
+    SearchIndex index;
+    QHash<QString, EntryInternal> entries;
+    for (int id = 0; id < 50; ++id) {
+        const EntryInternal entry = createEntry(id, 0);
+        index.insert(entry);
+        entries.insert(entry.uniqueId(), entry);
+    }
+    for (int id = 0; id < 50; id += 3) {
+        index.remove(entries.take(QString::number(id)));
+    }
+    compareWithScan(index, entries);
+
+    // removed entries can come back
+    const EntryInternal entry = createEntry(3, 1);
+    index.insert(entry);
+    entries.insert(entry.uniqueId(), entry);
+    compareWithScan(index, entries);
+}
+
+void testSearchIndex::testRebuild()
+{
+    SearchIndex index;
+    QHash<QString, EntryInternal> entries;
+    // replacing and removing often enough drops the outdated versions from the index
+    for (int revision = 0; revision < 40; ++revision) {
+        for (int id = 0; id < 60; ++id) {
+            const EntryInternal entry = createEntry(id, revision);
+            if ((id + revision) % 7 == 0) {
+                index.remove(entry);
+                entries.remove(entry.uniqueId());
+            } else {
+                index.insert(entry);
+                entries.insert(entry.uniqueId(), entry);
+            }
+        }
+        if (revision % 10 == 9) {
+            compareWithScan(index, entries);
+        }
+    }
+    compareWithScan(index, entries);
+}
+
+void testSearchIndex::testClear()
+{
+    SearchIndex index;
+    index.insert(createEntry(1, 0));
+    index.clear();
+    QCOMPARE(index.size(), 0);
+    QVERIFY(index.search(QString()).isEmpty());
+    QVERIFY(index.search(QStringLiteral("entry")).isEmpty());
+
+    // entries without id are not indexed
+    EntryInternal entry = createEntry(1, 0);
+    entry.setUniqueId(QString());
+    index.insert(entry);
+    QCOMPARE(index.size(), 0);
+}
+
+QTEST_GUILESS_MAIN(testSearchIndex)
+#include "knewstuffsearchindextest.moc"
@@ -0,0 +1,529 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test for loading the catalog of a static provider from a local http server
+
+#include <QtTest/QtTest>
+#include <QString>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include "../src/core/feedparser_p.h"
+#include "../src/staticxml/localdirectoryprovider_p.h"
+#include "../src/staticxml/staticxmlprovider_p.h"
+
+using namespace KNS3;
+
+// answers GET requests with the document registered for their path and query, 404 otherwise;
+// documents have an ETag so the loader may cache them
+class FeedServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    explicit FeedServer(QObject *parent = 0)
+        : QTcpServer(parent)
+    {
+        connect(this, &QTcpServer::newConnection, this, &FeedServer::slotNewConnection);
+    }
+
+    QString url(const QString &path) const
+    {
+        return QStringLiteral("http://127.0.0.1:%1%2").arg(serverPort()).arg(path);
+    }
+
+    QHash<QString, QByteArray> documents;
+    QStringList requests;
+
+private Q_SLOTS:
+    void slotNewConnection()
+    {
+        while (QTcpSocket *socket = nextPendingConnection()) {
+            connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+                const QByteArray request = socket->peek(socket->bytesAvailable());
+                if (!request.contains("\r\n\r\n")) {
+                    return;
+                }
+                socket->readAll();
+                const QString path = QString::fromLatin1(request.split(' ').value(1));
+                requests.append(path);
+
+                QByteArray response;
+                if (documents.contains(path)) {
+                    const QByteArray body = documents.value(path);
+                    response = "HTTP/1.1 200 OK\r\nContent-Type: application/xml\r\nETag: \""
+                               + QCryptographicHash::hash(body, QCryptographicHash::Sha1).toHex() + "\"\r\nContent-Length: "
+                               + QByteArray::number(body.size()) + "\r\n\r\n" + body;
+                } else {
+                    response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+                }
+                socket->write(response);
+                socket->disconnectFromHost();
+            });
+            connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        }
+    }
+};
+
+class testStaticXmlProvider: public QObject
+{
+    Q_OBJECT
+private:
+    static QByteArray stuff(const QString &id, const QString &version);
+    static QByteArray stuff(const QString &id, const QString &category, const QString &releaseDate, int rating, int downloads);
+    // a catalog of the entries a to d with categories and data to sort by
+    static QByteArray sortableCatalog();
+    // a provider for the feeds of m_server, with entry a installed in version 1.0
+    StaticXmlProvider *createProvider(const QString &attributes = QString(), bool delta = true);
+    // the entries the provider answers @p request with, none if it fails or takes too long
+    EntryInternal::List load(StaticXmlProvider *provider, const Provider::SearchRequest &request);
+    static QStringList ids(const EntryInternal::List &entries);
+    // whether the document at @p path of m_server is in the cache on disk
+    bool isCached(const QString &path) const;
+
+    FeedServer *m_server;
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void testDelta();
+    void testDeltaFailed();
+    void testDeltaWithFullCatalog();
+    void testWithoutDelta();
+    void testDeltaNotCached();
+    void testUpdateManifestUnchanged();
+    void testUpdateManifestChanged();
+    void testUpdateManifestWithoutEntryUrls();
+    void testBinaryFeed();
+    void testLocalDirectory();
+    void testPages();
+    void testCategories();
+    void testSortModes();
+    void testSortFeed();
+};
+
+QByteArray testStaticXmlProvider::stuff(const QString &id, const QString &version)
+{
+    return QStringLiteral("<stuff><id>%1</id><name>Entry %1</name><version>%2</version><payload>http://127.0.0.1/%1</payload></stuff>")
+           .arg(id, version).toUtf8();
+}
+
+QByteArray testStaticXmlProvider::stuff(const QString &id, const QString &category, const QString &releaseDate, int rating, int downloads)
+{
+    return QStringLiteral("<stuff category=\"%2\"><id>%1</id><name>Entry %1</name><version>1.0</version><releasedate>%3</releasedate>"
+                          "<rating>%4</rating><downloads>%5</downloads><payload>http://127.0.0.1/%1</payload></stuff>")
+           .arg(id, category, releaseDate).arg(rating).arg(downloads).toUtf8();
+}
+
+QByteArray testStaticXmlProvider::sortableCatalog()
+{
+    return "<knewstuff generation=\"1\">"
+           + stuff(QStringLiteral("a"), QStringLiteral("x"), QStringLiteral("2016-01-03"), 50, 7)
+           + stuff(QStringLiteral("b"), QStringLiteral("y"), QStringLiteral("2016-01-01"), 90, 3)
+           + stuff(QStringLiteral("c"), QStringLiteral("x"), QStringLiteral("2016-01-04"), 10, 9)
+           + stuff(QStringLiteral("d"), QStringLiteral("z"), QStringLiteral("2016-01-02"), 70, 1)
+           + "</knewstuff>";
+}
+
+StaticXmlProvider *testStaticXmlProvider::createProvider(const QString &attributes, bool delta)
+{
+    QDomDocument doc;
+    doc.setContent(QStringLiteral("<provider downloadurl=\"%1\" %2 nouploadurl=\"http://127.0.0.1/\" %3><title>Test</title></provider>")
+                   .arg(m_server->url(QStringLiteral("/feed.xml")),
+                        delta ? QStringLiteral("downloadurl-delta=\"%1\"").arg(m_server->url(QStringLiteral("/delta.xml?since={since}"))) : QString(),
+                        attributes));
+
+    StaticXmlProvider *provider = new StaticXmlProvider;
+    provider->setParent(this);
+    if (!provider->setProviderXML(doc.documentElement())) {
+        return 0;
+    }
+
+    EntryInternal installed;
+    installed.setUniqueId(QStringLiteral("a"));
+    installed.setName(QStringLiteral("Entry a"));
+    installed.setVersion(QStringLiteral("1.0"));
+    installed.setProviderId(provider->id());
+    installed.setStatus(Entry::Installed);
+    provider->setCachedEntries(EntryInternal::List() << installed);
+    return provider;
+}
+
+EntryInternal::List testStaticXmlProvider::load(StaticXmlProvider *provider, const Provider::SearchRequest &request)
+{
+    EntryInternal::List result;
+    bool done = false;
+    QMetaObject::Connection finished = connect(provider, &Provider::loadingFinished, this,
+            [&](const Provider::SearchRequest &r, const EntryInternal::List &entries) {
+        if (r == request) {
+            result = entries;
+            done = true;
+        }
+    });
+    QMetaObject::Connection failed = connect(provider, &Provider::loadingFailed, this, [&](const Provider::SearchRequest &r) {
+        if (r == request) {
+            done = true;
+        }
+    });
+    provider->loadEntries(request);
+    QElapsedTimer timer;
+    timer.start();
+    while (!done && timer.elapsed() < 10000) {
+        QTest::qWait(10);
+    }
+    disconnect(finished);
+    disconnect(failed);
+    return result;
+}
+
+QStringList testStaticXmlProvider::ids(const EntryInternal::List &entries)
+{
+    QStringList result;
+    foreach (const EntryInternal &entry, entries) {
+        result.append(entry.uniqueId());
+    }
+    return result;
+}
+
+bool testStaticXmlProvider::isCached(const QString &path) const
+{
+    const QByteArray hash = QCryptographicHash::hash(QUrl(m_server->url(path)).toEncoded(), QCryptographicHash::Sha1).toHex();
+    return QFile::exists(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+                         + QStringLiteral("/knewstuff3/xml/") + QString::fromLatin1(hash) + QStringLiteral(".info"));
+}
+
+void testStaticXmlProvider::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    m_server = new FeedServer(this);
+    QVERIFY(m_server->listen(QHostAddress::LocalHost));
+}
+
+void testStaticXmlProvider::init()
+{
+    m_server->requests.clear();
+    m_server->documents.clear();
+    m_server->documents.insert(QStringLiteral("/feed.xml"),
+                               "<knewstuff generation=\"1\">" + stuff(QStringLiteral("a"), QStringLiteral("1.0"))
+                               + stuff(QStringLiteral("b"), QStringLiteral("1.0")) + stuff(QStringLiteral("c"), QStringLiteral("1.0"))
+                               + "</knewstuff>");
+}
+
+void testStaticXmlProvider::testDelta()
+{
+    m_server->documents.insert(QStringLiteral("/delta.xml?since=1"),
+                               "<knewstuff-delta generation=\"2\">" + stuff(QStringLiteral("a"), QStringLiteral("2.0"))
+                               + stuff(QStringLiteral("d"), QStringLiteral("1.0")) + "<removed id=\"b\"/></knewstuff-delta>");
+    StaticXmlProvider *provider = createProvider();
+    QVERIFY(provider);
+
+    const Provider::SearchRequest request(Provider::Alphabetical, QString(), QStringList(), 0, 20);
+    QCOMPARE(ids(load(provider, request)), QStringList() << QStringLiteral("a") << QStringLiteral("b") << QStringLiteral("c"));
+    QCOMPARE(m_server->requests, QStringList() << QStringLiteral("/feed.xml"));
+
+    // update checks refresh the catalog
+    const EntryInternal::List updates = load(provider, Provider::SearchRequest(Provider::Updates, QString(), QStringList(), 0, 20));
+    QCOMPARE(m_server->requests, QStringList() << QStringLiteral("/feed.xml") << QStringLiteral("/delta.xml?since=1"));
+    QCOMPARE(ids(updates), QStringList() << QStringLiteral("a"));
+    QCOMPARE(updates.first().status(), Entry::Updateable);
+    QCOMPARE(updates.first().version(), QStringLiteral("1.0"));
+    QCOMPARE(updates.first().updateVersion(), QStringLiteral("2.0"));
+
+    // answered from the updated catalog
+    QCOMPARE(ids(load(provider, request)), QStringList() << QStringLiteral("a") << QStringLiteral("c") << QStringLiteral("d"));
+    QCOMPARE(m_server->requests.size(), 2);
+
+    // the next delta starts at the new generation
+    m_server->documents.insert(QStringLiteral("/delta.xml?since=2"), "<knewstuff-delta generation=\"3\"/>");
+    load(provider, Provider::SearchRequest(Provider::Updates, QString(), QStringList(), 0, 20));
+    QCOMPARE(m_server->requests.last(), QStringLiteral("/delta.xml?since=2"));
+}
+
+void testStaticXmlProvider::testDeltaFailed()
+{
+    StaticXmlProvider *provider = createProvider();
+    QVERIFY(provider);
+
+    const Provider::SearchRequest request(Provider::Alphabetical, QString(), QStringList(), 0, 20);
+    QCOMPARE(load(provider, request).size(), 3);
+
+    // the server has no delta, the whole catalog is loaded again
+    m_server->documents.insert(QStringLiteral("/feed.xml"),
+                               "<knewstuff generation=\"2\">" + stuff(QStringLiteral("a"), QStringLiteral("2.0")) + "</knewstuff>");
+    const EntryInternal::List updates = load(provider, Provider::SearchRequest(Provider::Updates, QString(), QStringList(), 0, 20));
+    QCOMPARE(m_server->requests, QStringList() << QStringLiteral("/feed.xml") << QStringLiteral("/delta.xml?since=1") << QStringLiteral("/feed.xml"));
+    QCOMPARE(ids(updates), QStringList() << QStringLiteral("a"));
+    QCOMPARE(ids(load(provider, request)), QStringList() << QStringLiteral("a"));
+}
+
+void testStaticXmlProvider::testDeltaWithFullCatalog()
+{
+    // the server cannot go back to generation 1 and sends its whole catalog, the catalog is loaded from its own url
+    const QByteArray catalog = "<knewstuff generation=\"5\">" + stuff(QStringLiteral("c"), QStringLiteral("1.0")) + "</knewstuff>";
+    m_server->documents.insert(QStringLiteral("/delta.xml?since=1"), catalog);
+    StaticXmlProvider *provider = createProvider();
+    QVERIFY(provider);
+
+    const Provider::SearchRequest request(Provider::Alphabetical, QString(), QStringList(), 0, 20);
+    QCOMPARE(load(provider, request).size(), 3);
+    m_server->documents.insert(QStringLiteral("/feed.xml"), catalog);
+    QVERIFY(load(provider, Provider::SearchRequest(Provider::Updates, QString(), QStringList(), 0, 20)).isEmpty());
+    QCOMPARE(m_server->requests, QStringList() << QStringLiteral("/feed.xml") << QStringLiteral("/delta.xml?since=1") << QStringLiteral("/feed.xml"));
+    QCOMPARE(ids(load(provider, request)), QStringList() << QStringLiteral("c"));
+    // the dropped entries are not found anymore
+    QVERIFY(load(provider, Provider::SearchRequest(Provider::Alphabetical, QStringLiteral("Entry b"), QStringList(), 0, 20)).isEmpty());
+
+    m_server->documents.insert(QStringLiteral("/delta.xml?since=5"), "<knewstuff-delta generation=\"6\"/>");
+    load(provider, Provider::SearchRequest(Provider::Updates, QString(), QStringList(), 0, 20));
+    QCOMPARE(m_server->requests.last(), QStringLiteral("/delta.xml?since=5"));
+}
+
+void testStaticXmlProvider::testWithoutDelta()
+{
+    // a catalog with a generation on a host without delta feeds, refreshing loads the catalog
+    StaticXmlProvider *provider = createProvider(QString(), false);
+    QVERIFY(provider);
+
+    QCOMPARE(load(provider, Provider::SearchRequest(Provider::Alphabetical, QString(), QStringList(), 0, 20)).size(), 3);
+    load(provider, Provider::SearchRequest(Provider::Updates, QString(), QStringList(), 0, 20));
+    QCOMPARE(m_server->requests, QStringList() << QStringLiteral("/feed.xml") << QStringLiteral("/feed.xml"));
+    QVERIFY(isCached(QStringLiteral("/feed.xml")));
+}
+
+void testStaticXmlProvider::testDeltaNotCached()
+{
+    m_server->documents.insert(QStringLiteral("/delta.xml?since=1"), "<knewstuff-delta generation=\"2\"/>");
+    m_server->documents.insert(QStringLiteral("/updates.xml"), "<updates/>");
+    StaticXmlProvider *provider = createProvider(QStringLiteral("downloadurl-updates=\"%1\"").arg(m_server->url(QStringLiteral("/updates.xml"))));
+    QVERIFY(provider);
+
+    load(provider, Provider::SearchRequest(Provider::Alphabetical, QString(), QStringList(), 0, 20));
+    load(provider, Provider::SearchRequest(Provider::Updates, QString(), QStringList(), 0, 20));
+    // the catalog is refreshed from the delta feed on the next update check after the manifest
+    m_server->documents.insert(QStringLiteral("/updates.xml"), "<updates><entry id=\"a\" version=\"2.0\"/></updates>");
+    load(provider, Provider::SearchRequest(Provider::Updates, QString(), QStringList(), 0, 20));
+    QCOMPARE(m_server->requests, QStringList() << QStringLiteral("/feed.xml") << QStringLiteral("/updates.xml")
+             << QStringLiteral("/updates.xml") << QStringLiteral("/delta.xml?since=1"));
+
+    // only the catalog is worth keeping
+    QVERIFY(isCached(QStringLiteral("/feed.xml")));
+    QVERIFY(!isCached(QStringLiteral("/updates.xml")));
+    QVERIFY(!isCached(QStringLiteral("/delta.xml?since=1")));
+}
+
+void testStaticXmlProvider::testUpdateManifestUnchanged()
+{
+    // the installed entry has no release date and no checksum, only the version is compared
+    m_server->documents.insert(QStringLiteral("/updates.xml"),
+                               "<updates><entry id=\"a\" version=\"1.0\" releasedate=\"2016-01-01\" checksum=\"abc\" href=\"entries/a.xml\"/>"
+                               "<entry id=\"b\" version=\"2.0\" href=\"entries/b.xml\"/></updates>");
+    StaticXmlProvider *provider = createProvider(QStringLiteral("downloadurl-updates=\"%1\"").arg(m_server->url(QStringLiteral("/updates.xml"))));
+    QVERIFY(provider);
+
+    QVERIFY(load(provider, Provider::SearchRequest(Provider::Updates, QString(), QStringList(), 0, 20)).isEmpty());
+    QCOMPARE(m_server->requests, QStringList() << QStringLiteral("/updates.xml"));
+}
+
+void testStaticXmlProvider::testUpdateManifestChanged()
+{
+    m_server->documents.insert(QStringLiteral("/updates.xml"),
+                               "<updates><entry id=\"a\" version=\"2.0\" href=\"entries/a.xml\"/>"
+                               "<entry id=\"b\" version=\"2.0\" href=\"entries/b.xml\"/></updates>");
+    // the payload is relative to the entry document, not to the catalog
+    m_server->documents.insert(QStringLiteral("/entries/a.xml"),
+                               "<stuff><id>a</id><name>Entry a</name><version>2.0</version><payload>a.tar.gz</payload></stuff>");
+    StaticXmlProvider *provider = createProvider(QStringLiteral("downloadurl-updates=\"%1\"").arg(m_server->url(QStringLiteral("/updates.xml"))));
+    QVERIFY(provider);
+
+    // only the changed entry is loaded, not the catalog
+    const Provider::SearchRequest request(Provider::Updates, QString(), QStringList(), 0, 20);
+    EntryInternal::List updates = load(provider, request);
+    QCOMPARE(m_server->requests, QStringList() << QStringLiteral("/updates.xml") << QStringLiteral("/entries/a.xml"));
+    QCOMPARE(ids(updates), QStringList() << QStringLiteral("a"));
+    QCOMPARE(updates.first().status(), Entry::Updateable);
+    QCOMPARE(updates.first().version(), QStringLiteral("1.0"));
+    QCOMPARE(updates.first().updateVersion(), QStringLiteral("2.0"));
+    QCOMPARE(updates.first().payload(), m_server->url(QStringLiteral("/entries/a.tar.gz")));
+
+    // the update is known now, the entry is not loaded again
+    updates = load(provider, request);
+    QCOMPARE(m_server->requests.size(), 3);
+    QCOMPARE(m_server->requests.last(), QStringLiteral("/updates.xml"));
+    QCOMPARE(ids(updates), QStringList() << QStringLiteral("a"));
+    // comparing with the known update leaves the installed version alone
+    QCOMPARE(updates.first().version(), QStringLiteral("1.0"));
+    QCOMPARE(updates.first().updateVersion(), QStringLiteral("2.0"));
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Installed, QString(), QStringList(), 0, 20))), QStringList() << QStringLiteral("a"));
+    QCOMPARE(load(provider, Provider::SearchRequest(Provider::Installed, QString(), QStringList(), 0, 20)).first().version(), QStringLiteral("1.0"));
+}
+
+void testStaticXmlProvider::testUpdateManifestWithoutEntryUrls()
+{
+    // the same version with a new checksum, the catalog is needed to find the entry
+    m_server->documents.insert(QStringLiteral("/updates.xml"), "<updates><entry id=\"a\" version=\"1.0\" checksum=\"new\"/></updates>");
+    m_server->documents.insert(QStringLiteral("/feed.xml"),
+                               "<knewstuff><stuff><id>a</id><name>Entry a</name><version>1.0</version><checksum>new</checksum>"
+                               "<payload>http://127.0.0.1/a</payload></stuff></knewstuff>");
+    StaticXmlProvider *provider = createProvider(QStringLiteral("downloadurl-updates=\"%1\"").arg(m_server->url(QStringLiteral("/updates.xml"))));
+    QVERIFY(provider);
+    EntryInternal installed;
+    installed.setUniqueId(QStringLiteral("a"));
+    installed.setVersion(QStringLiteral("1.0"));
+    installed.setChecksum(QStringLiteral("old"));
+    installed.setProviderId(provider->id());
+    installed.setStatus(Entry::Installed);
+    provider->setCachedEntries(EntryInternal::List() << installed);
+
+    const EntryInternal::List updates = load(provider, Provider::SearchRequest(Provider::Updates, QString(), QStringList(), 0, 20));
+    QCOMPARE(m_server->requests, QStringList() << QStringLiteral("/updates.xml") << QStringLiteral("/feed.xml"));
+    QCOMPARE(ids(updates), QStringList() << QStringLiteral("a"));
+    QCOMPARE(updates.first().checksum(), QStringLiteral("new"));
+}
+
+void testStaticXmlProvider::testBinaryFeed()
+{
+    QByteArray feed = FeedParser::binaryHeader(QStringLiteral("7"));
+    foreach (const QString &id, QStringList() << QStringLiteral("a") << QStringLiteral("b")) {
+        QDomDocument doc;
+        doc.setContent(stuff(id, QStringLiteral("2.0")));
+        EntryInternal entry;
+        QVERIFY(entry.setEntryXML(doc.documentElement()));
+        feed += FeedParser::binaryRecord(entry);
+    }
+    feed += FeedParser::binaryEnd();
+    m_server->documents.insert(QStringLiteral("/feed.xml"), feed);
+    m_server->documents.insert(QStringLiteral("/delta.xml?since=7"), "<knewstuff-delta generation=\"8\"/>");
+    StaticXmlProvider *provider = createProvider();
+    QVERIFY(provider);
+
+    const EntryInternal::List entries = load(provider, Provider::SearchRequest(Provider::Alphabetical, QString(), QStringList(), 0, 20));
+    QCOMPARE(ids(entries), QStringList() << QStringLiteral("a") << QStringLiteral("b"));
+    QCOMPARE(entries.first().status(), Entry::Updateable);
+    QCOMPARE(entries.first().updateVersion(), QStringLiteral("2.0"));
+    QCOMPARE(entries.last().name(), QStringLiteral("Entry b"));
+
+    // the generation of the binary feed is used for deltas
+    load(provider, Provider::SearchRequest(Provider::Updates, QString(), QStringList(), 0, 20));
+    QCOMPARE(m_server->requests.last(), QStringLiteral("/delta.xml?since=7"));
+}
+
+void testStaticXmlProvider::testLocalDirectory()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QFile index(directory.path() + QStringLiteral("/index.xml"));
+    QVERIFY(index.open(QIODevice::WriteOnly));
+    index.write("<knewstuff><stuff><id>x</id><name>Entry x</name><payload>sub/x%20y.tar.gz</payload><preview>sub/x.png</preview></stuff></knewstuff>");
+    index.close();
+
+    QDomDocument doc;
+    doc.setContent(QStringLiteral("<provider type=\"directory\" path=\"%1\" index=\"index.xml\"><title>Mirror</title></provider>").arg(directory.path()));
+    LocalDirectoryProvider *provider = new LocalDirectoryProvider;
+    provider->setParent(this);
+    QVERIFY(provider->setProviderXML(doc.documentElement()));
+    QCOMPARE(provider->name(), QStringLiteral("Mirror"));
+
+    // payloads are resolved to the files in the directory
+    const EntryInternal::List entries = load(provider, Provider::SearchRequest(Provider::Alphabetical, QString(), QStringList(), 0, 20));
+    QCOMPARE(entries.size(), 1);
+    QCOMPARE(QUrl(entries.first().payload()), QUrl::fromLocalFile(directory.path() + QStringLiteral("/sub/x y.tar.gz")));
+    QCOMPARE(QUrl(entries.first().previewUrl()), QUrl::fromLocalFile(directory.path() + QStringLiteral("/sub/x.png")));
+    QVERIFY(m_server->requests.isEmpty());
+}
+
+void testStaticXmlProvider::testPages()
+{
+    m_server->documents.insert(QStringLiteral("/feed.xml"), sortableCatalog());
+    StaticXmlProvider *provider = createProvider();
+    QVERIFY(provider);
+
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Alphabetical, QString(), QStringList(), 0, 3))),
+             QStringList() << QStringLiteral("a") << QStringLiteral("b") << QStringLiteral("c"));
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Alphabetical, QString(), QStringList(), 1, 3))),
+             QStringList() << QStringLiteral("d"));
+    QVERIFY(load(provider, Provider::SearchRequest(Provider::Alphabetical, QString(), QStringList(), 2, 3)).isEmpty());
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Rating, QString(), QStringList(), 1, 2))),
+             QStringList() << QStringLiteral("a") << QStringLiteral("c"));
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Alphabetical, QStringLiteral("Entry"), QStringList(), 1, 2))),
+             QStringList() << QStringLiteral("c") << QStringLiteral("d"));
+
+    // all pages come from the catalog loaded for the first one
+    QCOMPARE(m_server->requests, QStringList() << QStringLiteral("/feed.xml"));
+}
+
+void testStaticXmlProvider::testCategories()
+{
+    m_server->documents.insert(QStringLiteral("/feed.xml"), sortableCatalog());
+    StaticXmlProvider *provider = createProvider();
+    QVERIFY(provider);
+
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Alphabetical, QString(), QStringList(), 0, 20))),
+             QStringList() << QStringLiteral("a") << QStringLiteral("b") << QStringLiteral("c") << QStringLiteral("d"));
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Alphabetical, QString(), QStringList() << QStringLiteral("x"), 0, 20))),
+             QStringList() << QStringLiteral("a") << QStringLiteral("c"));
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Alphabetical, QString(),
+                                                        QStringList() << QStringLiteral("z") << QStringLiteral("x"), 0, 20))),
+             QStringList() << QStringLiteral("a") << QStringLiteral("c") << QStringLiteral("d"));
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Alphabetical, QStringLiteral("Entry c"), QStringList() << QStringLiteral("x"), 0, 20))),
+             QStringList() << QStringLiteral("c"));
+    QVERIFY(load(provider, Provider::SearchRequest(Provider::Alphabetical, QString(), QStringList() << QStringLiteral("other"), 0, 20)).isEmpty());
+    QCOMPARE(m_server->requests, QStringList() << QStringLiteral("/feed.xml"));
+}
+
+void testStaticXmlProvider::testSortModes()
+{
+    // the catalog has the data for every sort mode, the sorted feeds are not needed
+    m_server->documents.insert(QStringLiteral("/feed.xml"), sortableCatalog());
+    StaticXmlProvider *provider = createProvider(QStringLiteral("downloadurl-latest=\"%1\" downloadurl-score=\"%2\" downloadurl-downloads=\"%3\"")
+                                                 .arg(m_server->url(QStringLiteral("/latest.xml")), m_server->url(QStringLiteral("/score.xml")),
+                                                      m_server->url(QStringLiteral("/downloads.xml"))));
+    QVERIFY(provider);
+
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Newest, QString(), QStringList(), 0, 20))),
+             QStringList() << QStringLiteral("c") << QStringLiteral("a") << QStringLiteral("d") << QStringLiteral("b"));
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Rating, QString(), QStringList(), 0, 20))),
+             QStringList() << QStringLiteral("b") << QStringLiteral("d") << QStringLiteral("a") << QStringLiteral("c"));
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Downloads, QString(), QStringList(), 0, 20))),
+             QStringList() << QStringLiteral("c") << QStringLiteral("a") << QStringLiteral("b") << QStringLiteral("d"));
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Alphabetical, QString(), QStringList(), 0, 20))),
+             QStringList() << QStringLiteral("a") << QStringLiteral("b") << QStringLiteral("c") << QStringLiteral("d"));
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Installed, QString(), QStringList(), 0, 20))),
+             QStringList() << QStringLiteral("a"));
+    QCOMPARE(m_server->requests, QStringList() << QStringLiteral("/feed.xml"));
+}
+
+void testStaticXmlProvider::testSortFeed()
+{
+    // the catalog has no ratings, the feed sorted by score is loaded once and its order kept
+    m_server->documents.insert(QStringLiteral("/score.xml"),
+                               "<knewstuff>" + stuff(QStringLiteral("c"), QStringLiteral("1.0")) + stuff(QStringLiteral("b"), QStringLiteral("1.0"))
+                               + stuff(QStringLiteral("a"), QStringLiteral("1.0")) + "</knewstuff>");
+    StaticXmlProvider *provider = createProvider(QStringLiteral("downloadurl-score=\"%1\"").arg(m_server->url(QStringLiteral("/score.xml"))));
+    QVERIFY(provider);
+
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Rating, QString(), QStringList(), 0, 2))),
+             QStringList() << QStringLiteral("c") << QStringLiteral("b"));
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Rating, QString(), QStringList(), 1, 2))),
+             QStringList() << QStringLiteral("a"));
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Alphabetical, QString(), QStringList(), 0, 20))),
+             QStringList() << QStringLiteral("a") << QStringLiteral("b") << QStringLiteral("c"));
+    QCOMPARE(ids(load(provider, Provider::SearchRequest(Provider::Rating, QStringLiteral("Entry"), QStringList(), 0, 20))),
+             QStringList() << QStringLiteral("c") << QStringLiteral("b") << QStringLiteral("a"));
+    QCOMPARE(m_server->requests, QStringList() << QStringLiteral("/feed.xml") << QStringLiteral("/score.xml"));
+}
+
+QTEST_GUILESS_MAIN(testStaticXmlProvider)
+#include "knewstuffstaticxmlprovidertest.moc"
@@ -17,6 +17,8 @@
 
 #include "atticaprovider_p.h"
 
+#include <QtCore/QTimer>
+
 #include <knewstuff_debug.h>
 #include <klocalizedstring.h>
 #include <kio/job.h>
@@ -35,8 +37,21 @@ using namespace Attica;
 namespace KNS3
 {
 
+// how many contents to ask for per page when looking for updates, the maximum the OCS API allows
+static const int UpdateSweepPageSize = 100;
+// give up paging through the newest contents after this many pages
+static const int MaxUpdateSweepPages = 5;
+// how many single content requests may run at the same time during an update check
+static const int MaxUpdateJobs = 4;
+// retrying after the server refused a request starts with this delay and doubles up to the maximum
+static const int MinUpdateBackoff = 2000;
+static const int MaxUpdateBackoff = 64000;
+
 AtticaProvider::AtticaProvider(const QStringList &categories)
-    : mEntryJob(0)
+    : m_updateCheckRunning(false)
+    , m_updateSweepPage(0)
+    , m_updateBackoff(0)
+    , m_updatePaused(false)
     , mInitialized(false)
 {
     // init categories map with invalid categories
@@ -50,7 +65,10 @@ AtticaProvider::AtticaProvider(const QStringList &categories)
 }
 
 AtticaProvider::AtticaProvider(const Attica::Provider &provider, const QStringList &categories)
-    : mEntryJob(0)
+    : m_updateCheckRunning(false)
+    , m_updateSweepPage(0)
+    , m_updateBackoff(0)
+    , m_updatePaused(false)
     , mInitialized(false)
 {
     // init categories map with invalid categories
@@ -95,7 +113,8 @@ bool AtticaProvider::setProviderXML(const QDomElement &xmldata)
 
 void AtticaProvider::setCachedEntries(const KNS3::EntryInternal::List &cachedEntries)
 {
-    mCachedEntries = cachedEntries;
+    mCachedEntries = EntryStore();
+    mCachedEntries.insert(cachedEntries);
 }
 
 void AtticaProvider::providerLoaded(const Attica::Provider &provider)
@@ -152,12 +171,6 @@ bool AtticaProvider::isInitialized() const
 
 void AtticaProvider::loadEntries(const KNS3::Provider::SearchRequest &request)
 {
-    if (mEntryJob) {
-        mEntryJob->abort();
-        mEntryJob = 0;
-    }
-
-    mCurrentRequest = request;
     if (request.sortMode == Installed) {
         if (request.page == 0) {
             emit loadingFinished(request, installedEntries());
@@ -168,6 +181,7 @@ void AtticaProvider::loadEntries(const KNS3::Provider::SearchRequest &request)
     }
 
     if (request.sortMode == Updates) {
+        mCurrentRequest = request;
         checkForUpdates();
         return;
     }
@@ -188,19 +202,183 @@ void AtticaProvider::loadEntries(const KNS3::Provider::SearchRequest &request)
     ListJob<Content> *job = m_provider.searchContents(categoriesToSearch, request.searchTerm, sorting, request.page, request.pageSize);
     connect(job, &BaseJob::finished, this, &AtticaProvider::categoryContentsLoaded);
 
-    mEntryJob = job;
+    mEntryJobs.insert(job, request);
     job->start();
 }
 
+void AtticaProvider::abortRequest(const KNS3::Provider::SearchRequest &request)
+{
+    for (QHash<Attica::BaseJob *, Provider::SearchRequest>::iterator it = mEntryJobs.begin(); it != mEntryJobs.end(); ++it) {
+        if (it.value() == request) {
+            BaseJob *job = it.key();
+            mEntryJobs.erase(it);
+            job->abort();
+            return;
+        }
+    }
+}
+
 void AtticaProvider::checkForUpdates()
 {
-    foreach (const EntryInternal &e, mCachedEntries) {
-        ItemJob<Content> *job = m_provider.requestContent(e.uniqueId());
-        connect(job, &BaseJob::finished, this, &AtticaProvider::detailsLoaded);
-        m_updateJobs.insert(job);
+    if (m_updateCheckRunning) {
+        return;
+    }
+
+    m_updatePending.clear();
+    m_updateQueue.clear();
+    m_updateOldestDate = QDate();
+    foreach (const EntryInternal &e, mCachedEntries.entries()) {
+        if (e.status() != Entry::Installed && e.status() != Entry::Updateable) {
+            continue;
+        }
+        m_updatePending.insert(e.uniqueId());
+        if (e.releaseDate().isValid() && (!m_updateOldestDate.isValid() || e.releaseDate() < m_updateOldestDate)) {
+            m_updateOldestDate = e.releaseDate();
+        }
+    }
+    if (m_updatePending.isEmpty()) {
+        finishUpdateCheck();
+        return;
+    }
+
+    qCDebug(KNEWSTUFF) << "Checking for updates of" << m_updatePending.size() << "entries";
+    m_updateCheckRunning = true;
+    m_updateSweepPage = 0;
+    startUpdateSweep();
+}
+
+void AtticaProvider::startUpdateSweep()
+{
+    m_updatePaused = false;
+    ListJob<Content> *job = m_provider.searchContents(mCategoryMap.values(), QString(), Attica::Provider::Newest, m_updateSweepPage, UpdateSweepPageSize);
+    connect(job, &BaseJob::finished, this, &AtticaProvider::updateSweepLoaded);
+    m_updateJobs.insert(job, QString());
+    job->start();
+}
+
+void AtticaProvider::updateSweepLoaded(BaseJob *job)
+{
+    m_updateJobs.remove(job);
+    if (isRateLimited(job)) {
+        if (backOffUpdateCheck()) {
+            QTimer::singleShot(m_updateBackoff, this, SLOT(startUpdateSweep()));
+        }
+        return;
+    }
+    m_updateBackoff = 0;
+
+    if (!jobSuccess(job)) {
+        // check the remaining entries one by one
+        m_updateQueue = m_updatePending.toList();
+        startUpdateJobs();
+        return;
+    }
+
+    const Content::List contents = static_cast<ListJob<Content>*>(job)->itemList();
+    foreach (const Content &content, contents) {
+        if (m_updatePending.remove(content.id())) {
+            emit entryDetailsLoaded(entryFromAtticaContent(content));
+        }
+    }
+
+    if (contents.size() < UpdateSweepPageSize) {
+        // all contents have been seen, what is left is not available anymore
+        m_updatePending.clear();
+        finishUpdateCheck();
+        return;
+    }
+
+    // contents that have not been seen yet were changed before this date
+    const QDate cutOff = contents.last().updated().date();
+    if (!m_updatePending.isEmpty() && m_updateOldestDate.isValid() && cutOff >= m_updateOldestDate
+            && ++m_updateSweepPage < MaxUpdateSweepPages) {
+        startUpdateSweep();
+        return;
+    }
+
+    // entries released after the cut off would have shown up if they changed since,
+    // only the older ones need to be asked for; one changed on the cut off day may be on the next page
+    foreach (const EntryInternal &e, mCachedEntries.entries()) {
+        if (m_updatePending.contains(e.uniqueId()) && (!e.releaseDate().isValid() || e.releaseDate() <= cutOff)) {
+            m_updateQueue.append(e.uniqueId());
+        }
+    }
+    m_updatePending.clear();
+    qCDebug(KNEWSTUFF) << "Checking" << m_updateQueue.size() << "entries one by one";
+    startUpdateJobs();
+}
+
+void AtticaProvider::startUpdateJobs()
+{
+    m_updatePaused = false;
+    while (m_updateJobs.size() < MaxUpdateJobs && !m_updateQueue.isEmpty()) {
+        const QString id = m_updateQueue.takeFirst();
+        ItemJob<Content> *job = m_provider.requestContent(id);
+        connect(job, &BaseJob::finished, this, &AtticaProvider::updateContentLoaded);
+        m_updateJobs.insert(job, id);
         job->start();
-        qCDebug(KNEWSTUFF) << "Checking for update: " << e.name();
     }
+    if (m_updateJobs.isEmpty()) {
+        finishUpdateCheck();
+    }
+}
+
+void AtticaProvider::updateContentLoaded(BaseJob *job)
+{
+    const QString id = m_updateJobs.take(job);
+    if (isRateLimited(job)) {
+        m_updateQueue.prepend(id);
+        if (!m_updatePaused && backOffUpdateCheck()) {
+            QTimer::singleShot(m_updateBackoff, this, SLOT(startUpdateJobs()));
+        }
+        return;
+    }
+    m_updateBackoff = 0;
+
+    if (jobSuccess(job)) {
+        const Content content = static_cast<ItemJob<Content>*>(job)->result();
+        emit entryDetailsLoaded(entryFromAtticaContent(content));
+    }
+
+    if (!m_updatePaused) {
+        startUpdateJobs();
+    }
+}
+
+bool AtticaProvider::backOffUpdateCheck()
+{
+    if (m_updateBackoff >= MaxUpdateBackoff) {
+        // still refused after waiting the longest time, report what is known so far
+        emit signalError(i18n("Too many requests to server. Please try again in a few minutes."));
+        m_updatePending.clear();
+        m_updateQueue.clear();
+        if (m_updateJobs.isEmpty()) {
+            finishUpdateCheck();
+        }
+        return false;
+    }
+    m_updatePaused = true;
+    m_updateBackoff = qBound(MinUpdateBackoff, 2 * m_updateBackoff, MaxUpdateBackoff);
+    qCDebug(KNEWSTUFF) << "Too many requests, retrying the update check in" << m_updateBackoff << "ms";
+    return true;
+}
+
+void AtticaProvider::finishUpdateCheck()
+{
+    qCDebug(KNEWSTUFF) << "check update finished.";
+    m_updateCheckRunning = false;
+    QList<EntryInternal> updatable;
+    foreach (const EntryInternal &entry, mCachedEntries.entries()) {
+        if (entry.status() == Entry::Updateable) {
+            updatable.append(entry);
+        }
+    }
+    emit loadingFinished(mCurrentRequest, updatable);
+}
+
+bool AtticaProvider::isRateLimited(BaseJob *job)
+{
+    return job->metadata().error() == Attica::Metadata::OcsError && job->metadata().statusCode() == 200;
 }
 
 void AtticaProvider::loadEntryDetails(const KNS3::EntryInternal &entry)
@@ -217,24 +395,18 @@ void AtticaProvider::detailsLoaded(BaseJob *job)
         Content content = contentJob->result();
         EntryInternal entry = entryFromAtticaContent(content);
         emit entryDetailsLoaded(entry);
-        qCDebug(KNEWSTUFF) << "check update finished: " << entry.name();
-    }
-
-    if (m_updateJobs.remove(job) && m_updateJobs.isEmpty()) {
-        qCDebug(KNEWSTUFF) << "check update finished.";
-        QList<EntryInternal> updatable;
-        foreach (const EntryInternal &entry, mCachedEntries) {
-            if (entry.status() == Entry::Updateable) {
-                updatable.append(entry);
-            }
-        }
-        emit loadingFinished(mCurrentRequest, updatable);
     }
 }
 
 void AtticaProvider::categoryContentsLoaded(BaseJob *job)
 {
+    if (!mEntryJobs.contains(job)) {
+        // aborted
+        return;
+    }
+    const Provider::SearchRequest request = mEntryJobs.take(job);
     if (!jobSuccess(job)) {
+        emit loadingFailed(request);
         return;
     }
 
@@ -247,9 +419,8 @@ void AtticaProvider::categoryContentsLoaded(BaseJob *job)
         entries.append(entryFromAtticaContent(content));
     }
 
-    qCDebug(KNEWSTUFF) << "loaded: " << mCurrentRequest.hashForRequest() << " count: " << entries.size();
-    emit loadingFinished(mCurrentRequest, entries);
-    mEntryJob = 0;
+    qCDebug(KNEWSTUFF) << "loaded: " << request.hashForRequest() << " count: " << entries.size();
+    emit loadingFinished(request, entries);
 }
 
 Attica::Provider::SortMode AtticaProvider::atticaSortMode(const SortMode &sortMode)
@@ -271,7 +442,12 @@ void AtticaProvider::loadPayloadLink(const KNS3::EntryInternal &entry, int linkI
     Attica::Content content = mCachedContent.value(entry.uniqueId());
     const DownloadDescription desc = content.downloadUrlDescription(linkId);
 
-    if (desc.hasPrice()) {
+    if (desc.hasPrice() && !isInteractive()) {
+        // buying needs the consent of the user
+        qCDebug(KNEWSTUFF) << "Not buying" << entry.uniqueId() << "without interaction";
+        emit signalError(i18n("%1 is not free, it cannot be bought without interaction.", entry.name()));
+        emit payloadLinkFailed(entry);
+    } else if (desc.hasPrice()) {
         // Ask for balance, then show information...
         ItemJob<AccountBalance> *job = m_provider.requestAccountBalance();
         connect(job, &BaseJob::finished, this, &AtticaProvider::accountBalanceLoaded);
@@ -291,14 +467,15 @@ void AtticaProvider::loadPayloadLink(const KNS3::EntryInternal &entry, int linkI
 
 void AtticaProvider::accountBalanceLoaded(Attica::BaseJob *baseJob)
 {
+    QPair<EntryInternal, int> pair = mDownloadLinkJobs.take(baseJob);
     if (!jobSuccess(baseJob)) {
+        emit payloadLinkFailed(pair.first);
         return;
     }
 
     ItemJob<AccountBalance> *job = static_cast<ItemJob<AccountBalance>*>(baseJob);
     AccountBalance item = job->result();
 
-    QPair<EntryInternal, int> pair = mDownloadLinkJobs.take(job);
     EntryInternal entry(pair.first);
     Content content = mCachedContent.value(entry.uniqueId());
     if (content.downloadUrlDescription(pair.second).priceAmount() < item.balance()) {
@@ -315,26 +492,28 @@ void AtticaProvider::accountBalanceLoaded(Attica::BaseJob *baseJob)
             mDownloadLinkJobs[job] = qMakePair(entry, pair.second);
             job->start();
         } else {
-            return;
+            emit payloadLinkFailed(entry);
         }
     } else {
         qCDebug(KNEWSTUFF) << "You don't have enough money on your account!"
                << content.downloadUrlDescription(0).priceAmount() << " balance: " << item.balance();
         KMessageBox::information(0, i18n("Your account balance is too low:\nYour balance: %1\nPrice: %2",
                                          item.balance(), content.downloadUrlDescription(0).priceAmount()));
+        emit payloadLinkFailed(entry);
     }
 }
 
 void AtticaProvider::downloadItemLoaded(BaseJob *baseJob)
 {
+    EntryInternal entry = mDownloadLinkJobs.take(baseJob).first;
     if (!jobSuccess(baseJob)) {
+        emit payloadLinkFailed(entry);
         return;
     }
 
     ItemJob<DownloadItem> *job = static_cast<ItemJob<DownloadItem>*>(baseJob);
     DownloadItem item = job->result();
 
-    EntryInternal entry = mDownloadLinkJobs.take(job).first;
     entry.setPayload(QString(item.url().toString()));
     emit payloadLinkLoaded(entry);
 }
@@ -342,7 +521,7 @@ void AtticaProvider::downloadItemLoaded(BaseJob *baseJob)
 EntryInternal::List AtticaProvider::installedEntries() const
 {
     EntryInternal::List entries;
-    foreach (const EntryInternal &entry, mCachedEntries) {
+    foreach (const EntryInternal &entry, mCachedEntries.entries()) {
         if (entry.status() == Entry::Installed || entry.status() == Entry::Updateable) {
             entries.append(entry);
         }
@@ -412,20 +591,7 @@ EntryInternal AtticaProvider::entryFromAtticaContent(const Attica::Content &cont
     entry.setVersion(content.version());
     entry.setReleaseDate(content.updated().date());
 
-    int index = mCachedEntries.indexOf(entry);
-    if (index >= 0) {
-        EntryInternal &cacheEntry = mCachedEntries[index];
-        // check if updateable
-        if (((cacheEntry.status() == Entry::Installed) || (cacheEntry.status() == Entry::Updateable)) &&
-                ((cacheEntry.version() != entry.version()) || (cacheEntry.releaseDate() != entry.releaseDate()))) {
-            cacheEntry.setStatus(Entry::Updateable);
-            cacheEntry.setUpdateVersion(entry.version());
-            cacheEntry.setUpdateReleaseDate(entry.releaseDate());
-        }
-        entry = cacheEntry;
-    } else {
-        mCachedEntries.append(entry);
-    }
+    entry = mCachedEntries.merge(entry);
 
     entry.setName(content.name());
     entry.setHomepage(content.detailpage());
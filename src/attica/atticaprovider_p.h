@@ -18,12 +18,12 @@
 #define KNEWSTUFF3_ATTICAPROVIDER_P_H
 
 #include <QtCore/QSet>
-#include <QtCore/QPointer>
 
 #include <attica/providermanager.h>
 #include <attica/provider.h>
 #include <attica/content.h>
 
+#include "core/entrystore_p.h"
 #include "core/provider_p.h"
 
 namespace Attica
@@ -63,6 +63,7 @@ public:
     void setCachedEntries(const KNS3::EntryInternal::List &cachedEntries) Q_DECL_OVERRIDE;
 
     void loadEntries(const KNS3::Provider::SearchRequest &request) Q_DECL_OVERRIDE;
+    void abortRequest(const KNS3::Provider::SearchRequest &request) Q_DECL_OVERRIDE;
     void loadEntryDetails(const KNS3::EntryInternal &entry) Q_DECL_OVERRIDE;
     void loadPayloadLink(const EntryInternal &entry, int linkId) Q_DECL_OVERRIDE;
 
@@ -88,9 +89,17 @@ private Q_SLOTS:
     void votingFinished(Attica::BaseJob *);
     void becomeFanFinished(Attica::BaseJob *job);
     void detailsLoaded(Attica::BaseJob *job);
+    void updateSweepLoaded(Attica::BaseJob *job);
+    void updateContentLoaded(Attica::BaseJob *job);
+    void startUpdateSweep();
+    void startUpdateJobs();
 
 private:
     void checkForUpdates();
+    // the server asked us to slow down, returns false when giving up
+    bool backOffUpdateCheck();
+    void finishUpdateCheck();
+    static bool isRateLimited(Attica::BaseJob *job);
     EntryInternal::List installedEntries() const;
     bool jobSuccess(Attica::BaseJob *job) const;
 
@@ -104,7 +113,7 @@ private:
     Attica::ProviderManager m_providerManager;
     Attica::Provider m_provider;
 
-    KNS3::EntryInternal::List mCachedEntries;
+    KNS3::EntryStore mCachedEntries;
     QHash<QString, Attica::Content> mCachedContent;
 
     // Associate job and entry, this is needed when fetching
@@ -112,11 +121,27 @@ private:
     // when the result is there.
     QHash<Attica::BaseJob *, QPair<EntryInternal, int> > mDownloadLinkJobs;
 
-    // keep track of the current request
-    QPointer<Attica::BaseJob> mEntryJob;
+    // the requests that are being loaded, several pages can be on the wire at the same time
+    QHash<Attica::BaseJob *, Provider::SearchRequest> mEntryJobs;
+    // the request of the current update check
     Provider::SearchRequest mCurrentRequest;
 
-    QSet<Attica::BaseJob *> m_updateJobs;
+    // Update checks first page through the newest contents, which answers many installed
+    // entries with one request. Only the entries that could not be answered that way are
+    // requested one by one.
+    bool m_updateCheckRunning;
+    // ids of installed entries that have not been checked yet
+    QSet<QString> m_updatePending;
+    // release date of the oldest installed entry, the sweep can stop when reaching it
+    QDate m_updateOldestDate;
+    int m_updateSweepPage;
+    // ids to request one by one
+    QStringList m_updateQueue;
+    // running update jobs and the id they check (empty for sweep pages)
+    QHash<Attica::BaseJob *, QString> m_updateJobs;
+    // delay before retrying after the server refused a request, in ms
+    int m_updateBackoff;
+    bool m_updatePaused;
 
     bool mInitialized;
 
@@ -17,27 +17,92 @@
 */
 
 #include "cache_p.h"
+#include "registryfile_p.h"
+#include "registryjournal_p.h"
 
 #include <QtCore/QFile>
 #include <QtCore/QDir>
 #include <QtCore/QFileInfo>
+#include <QtCore/QDateTime>
+#include <QtCore/QRunnable>
+#include <QtCore/QSaveFile>
 #include <QtCore/QXmlStreamReader>
 #include <qstandardpaths.h>
 #include <knewstuff_debug.h>
 
+#include <algorithm>
+
 using namespace KNS3;
 
 typedef QHash<QString, QWeakPointer<Cache> > CacheHash;
 Q_GLOBAL_STATIC(CacheHash, s_caches)
 
-Cache::Cache(const QString &appName): QObject(0)
+// journal records after which the journal is folded into the registry file
+static const int CompactionThreshold = 256;
+
+// result sets and pages per set kept across sessions
+static const int PersistedResultSets = 4;
+static const int PersistedPages = 3;
+// results of older sessions are not shown anymore, in days
+static const int MaximumResultsAge = 7;
+static const quint32 ResultsMagic = 0x4b4e5253; // "KNRS"
+static const quint32 ResultsVersion = 1;
+
+namespace
+{
+// writes a registry file and drops the journal it replaces
+class CompactionTask : public QRunnable
 {
+public:
+    CompactionTask(Cache *cache, const QString &registryFile, const QByteArray &data, const QString &journalFile)
+        : m_cache(cache)
+        , m_registryFile(registryFile)
+        , m_data(data)
+        , m_journalFile(journalFile)
+    {
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        if (RegistryFile::write(m_registryFile, m_data)) {
+            QFile::remove(m_journalFile);
+        }
+        QMetaObject::invokeMethod(m_cache, "compactionFinished", Qt::QueuedConnection);
+    }
+
+private:
+    Cache *m_cache;
+    QString m_registryFile;
+    QByteArray m_data;
+    QString m_journalFile;
+};
+}
+
+Cache::Cache(const QString &appName)
+    : QObject(0)
+    , m_compacting(false)
+    , m_useCounter(0)
+    , m_requestCacheBytes(0)
+    , m_requestCacheMaxBytes(16 * 1024 * 1024)
+    , m_requestCacheTimeToLive(30 * 60 * 1000)
+    , m_resultsRead(false)
+{
+    m_clock.start();
     m_kns2ComponentName = appName;
 
     const QString path = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QLatin1Char('/') + QLatin1String("knewstuff3/");
     QDir().mkpath(path);
     registryFile = path + appName + ".knsregistry";
-    qCDebug(KNEWSTUFF) << "Using registry file: " << registryFile;
+    binaryRegistryFile = path + appName + ".knsregistry.bin";
+    m_registry.reset(new RegistryFile(binaryRegistryFile));
+    m_journal.reset(new RegistryJournal(binaryRegistryFile + ".journal"));
+    compactingJournalFile = binaryRegistryFile + ".journal.compacting";
+    m_compactionPool.setMaxThreadCount(1);
+
+    const QString cachePath = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QLatin1String("/knewstuff3/");
+    QDir().mkpath(cachePath);
+    resultsFile = cachePath + appName + ".knsresults";
+    qCDebug(KNEWSTUFF) << "Using registry file: " << binaryRegistryFile;
 }
 
 QSharedPointer<Cache> Cache::getCache(const QString &appName)
@@ -55,13 +120,59 @@ QSharedPointer<Cache> Cache::getCache(const QString &appName)
 
 Cache::~Cache()
 {
+    writeResults();
+    // a compaction that is still running holds the newest registry
+    m_compactionPool.waitForDone();
 }
 
 void Cache::readRegistry()
 {
     // read KNS2 registry first to migrate it
     readKns2MetaFiles();
+    // the migrated entries are only in memory
+    bool migrated = !m_entriesByProvider.isEmpty();
+
+    // the entries are decoded when their provider asks for them
+    if (m_registry->open()) {
+        m_pendingProviders = m_registry->providerIds().toSet();
+        qCDebug(KNEWSTUFF) << "Registry mapped, providers: " << m_pendingProviders.size();
+    } else {
+        // migrate the XML registry of earlier versions
+        readXmlRegistry();
+        migrated = !m_entriesByProvider.isEmpty();
+    }
 
+    // a journal left by an interrupted compaction is older than the current one
+    RegistryJournal compacting(compactingJournalFile);
+    replayJournal(&compacting);
+    replayJournal(m_journal.data());
+
+    if (migrated || m_journal->recordCount() >= CompactionThreshold) {
+        compactRegistry();
+    }
+}
+
+int Cache::replayJournal(RegistryJournal *journal)
+{
+    const QList<RegistryJournal::Record> records = journal->replay();
+    foreach (const RegistryJournal::Record &record, records) {
+        removeEntry(record.entry);
+        m_journaled.insert(record.entry, qHash(RegistryJournal::record(record.entry)));
+        if (record.operation == RegistryJournal::Put) {
+            insertEntry(record.entry);
+            m_journalRemoved.remove(record.entry);
+        } else {
+            m_journalRemoved.insert(record.entry);
+        }
+    }
+    if (!records.isEmpty()) {
+        qCDebug(KNEWSTUFF) << "Replayed" << records.size() << "registry journal records";
+    }
+    return records.size();
+}
+
+void Cache::readXmlRegistry()
+{
     QFile f(registryFile);
     if (!f.open(QIODevice::ReadOnly)) {
         qWarning() << "The file " << registryFile << " could not be opened.";
@@ -80,16 +191,42 @@ void Cache::readRegistry()
         return;
     }
 
+    int count = 0;
     QDomElement stuff = root.firstChildElement(QStringLiteral("stuff"));
     while (!stuff.isNull()) {
         EntryInternal e;
         e.setEntryXML(stuff);
         e.setSource(EntryInternal::Cache);
-        cache.insert(e);
+        insertEntry(e);
+        ++count;
         stuff = stuff.nextSiblingElement(QStringLiteral("stuff"));
     }
 
-    qCDebug(KNEWSTUFF) << "Cache read... entries: " << cache.size();
+    qCDebug(KNEWSTUFF) << "Cache read... entries: " << count;
+}
+
+void Cache::loadProvider(const QString &providerId)
+{
+    if (!m_pendingProviders.remove(providerId)) {
+        return;
+    }
+    foreach (const EntryInternal &entry, m_registry->entries(providerId)) {
+        // entries that changed since the registry was written are newer than the file
+        if (!containsEntry(entry) && !m_journalRemoved.contains(entry)) {
+            insertEntry(entry);
+            m_journaled.insert(entry, qHash(RegistryJournal::record(entry)));
+        }
+    }
+    if (m_pendingProviders.isEmpty()) {
+        m_registry->close();
+    }
+}
+
+void Cache::loadAllProviders()
+{
+    foreach (const QString &providerId, m_pendingProviders) {
+        loadProvider(providerId);
+    }
 }
 
 void Cache::readKns2MetaFiles()
@@ -167,7 +304,7 @@ void Cache::readKns2MetaFiles()
 
             e.setStatus(Entry::Installed);
 
-            cache.insert(e);
+            insertEntry(e);
             QDomDocument tmp(QStringLiteral("yay"));
             tmp.appendChild(e.entryXML());
             qCDebug(KNEWSTUFF) << "new entry: " << tmp.toString();
@@ -187,19 +324,99 @@ void Cache::readKns2MetaFiles()
 
 EntryInternal::List Cache::registryForProvider(const QString &providerId)
 {
+    loadProvider(providerId);
+
+    return m_entriesByProvider.value(providerId).values();
+}
+
+EntryInternal Cache::registryEntry(const QString &providerId, const QString &uniqueId)
+{
+    loadProvider(providerId);
+    return m_entriesByProvider.value(providerId).value(uniqueId);
+}
+
+EntryInternal::List Cache::entriesWithStatus(Entry::Status status)
+{
+    loadAllProviders();
+
     EntryInternal::List entries;
-    foreach (const EntryInternal &e, cache) {
-        if (e.providerId() == providerId) {
-            entries.append(e);
+    foreach (const EntryInternal &entry, m_entriesByStatus.value(status)) {
+        // the status index follows registered changes only
+        if (entry.status() == status) {
+            entries.append(entry);
         }
     }
     return entries;
 }
 
-void Cache::writeRegistry()
+bool Cache::containsEntry(const EntryInternal &entry) const
+{
+    QHash<QString, QHash<QString, EntryInternal> >::const_iterator it = m_entriesByProvider.constFind(entry.providerId());
+    return it != m_entriesByProvider.constEnd() && it->contains(entry.uniqueId());
+}
+
+void Cache::insertEntry(const EntryInternal &entry)
+{
+    m_entriesByProvider[entry.providerId()].insert(entry.uniqueId(), entry);
+    m_entriesByStatus[entry.status()].insert(entry);
+}
+
+void Cache::removeEntry(const EntryInternal &entry)
 {
-    qCDebug(KNEWSTUFF) << "Write registry";
+    QHash<QString, QHash<QString, EntryInternal> >::iterator it = m_entriesByProvider.find(entry.providerId());
+    if (it == m_entriesByProvider.end() || !it->remove(entry.uniqueId())) {
+        return;
+    }
+    if (it->isEmpty()) {
+        m_entriesByProvider.erase(it);
+    }
+    // the entry may have changed its status since it was indexed
+    for (QHash<int, QSet<EntryInternal> >::iterator status = m_entriesByStatus.begin(); status != m_entriesByStatus.end(); ++status) {
+        status->remove(entry);
+    }
+}
+
+void Cache::compactRegistry()
+{
+    if (m_compacting) {
+        return;
+    }
+    qCDebug(KNEWSTUFF) << "Compact registry, journal records: " << m_journal->recordCount();
+
+    // this also unmaps the file before it gets replaced
+    loadAllProviders();
+
+    // the records are kept until the new registry file is on disk
+    if (!m_journal->moveTo(compactingJournalFile)) {
+        qWarning() << "Cannot move the registry journal to" << compactingJournalFile;
+        return;
+    }
+    m_journalRemoved.clear();
 
+    const EntryInternal::List installed = entriesWithStatus(Entry::Installed) + entriesWithStatus(Entry::Updateable);
+    foreach (const EntryInternal &entry, installed) {
+        m_journaled.insert(entry, qHash(RegistryJournal::record(entry)));
+    }
+
+    // the XML registry is only kept up to date for debugging
+    if (KNEWSTUFF().isDebugEnabled()) {
+        writeXmlRegistry(installed);
+    }
+
+    m_compacting = true;
+    m_compactionPool.start(new CompactionTask(this, binaryRegistryFile, RegistryFile::encode(installed), compactingJournalFile));
+}
+
+void Cache::compactionFinished()
+{
+    m_compacting = false;
+    if (m_journal->recordCount() >= CompactionThreshold) {
+        compactRegistry();
+    }
+}
+
+void Cache::writeXmlRegistry(const EntryInternal::List &entries)
+{
     QFile f(registryFile);
     if (!f.open(QIODevice::WriteOnly | QIODevice::Text)) {
         qWarning() << "Cannot write meta information to '" << registryFile << "'." << endl;
@@ -211,12 +428,8 @@ void Cache::writeRegistry()
     QDomElement root = doc.createElement(QStringLiteral("hotnewstuffregistry"));
     doc.appendChild(root);
 
-    foreach (const EntryInternal &entry, cache) {
-        // Write the entry, unless the policy is CacheNever and the entry is not installed.
-        if (entry.status() == Entry::Installed || entry.status() == Entry::Updateable) {
-            QDomElement exml = entry.entryXML();
-            root.appendChild(exml);
-        }
+    foreach (const EntryInternal &entry, entries) {
+        root.appendChild(entry.entryXML());
     }
 
     QTextStream metastream(&f);
@@ -227,19 +440,394 @@ void Cache::writeRegistry()
 
 void Cache::registerChangedEntry(const KNS3::EntryInternal &entry)
 {
-    cache.insert(entry);
+    loadProvider(entry.providerId());
+    removeEntry(entry);
+    insertEntry(entry);
+
+    // entries that are being installed are journaled once the installation is done
+    if (entry.status() == Entry::Installing || entry.status() == Entry::Updating) {
+        return;
+    }
+    const QByteArray record = RegistryJournal::record(entry);
+    QHash<EntryInternal, uint>::const_iterator it = m_journaled.constFind(entry);
+    if (it != m_journaled.constEnd() && it.value() == qHash(record)) {
+        return;
+    }
+    // entries that have never been installed do not need to be removed
+    if (it == m_journaled.constEnd() && entry.status() != Entry::Installed
+            && entry.status() != Entry::Updateable && entry.status() != Entry::Deleted) {
+        return;
+    }
+    if (m_journal->append(record)) {
+        m_journaled.insert(entry, qHash(record));
+    }
+    if (m_journal->recordCount() >= CompactionThreshold) {
+        compactRegistry();
+    }
+}
+
+static KNS3::Provider::SearchRequest firstPage(const KNS3::Provider::SearchRequest &request)
+{
+    KNS3::Provider::SearchRequest first = request;
+    first.page = 0;
+    return first;
+}
+
+static qint64 entriesSize(const KNS3::EntryInternal::List &entries)
+{
+    qint64 size = 0;
+    foreach (const EntryInternal &entry, entries) {
+        size += entry.approximateSize();
+    }
+    return size;
 }
 
 void Cache::insertRequest(const KNS3::Provider::SearchRequest &request, const KNS3::EntryInternal::List &entries)
 {
-    // append new entries
-    requestCache[request.hashForRequest()].append(entries);
-    qCDebug(KNEWSTUFF) << request.hashForRequest() << " add: " << entries.size() << " keys: " << requestCache.keys();
+    CachedResultSet &resultSet = m_requestCache[firstPage(request)];
+    CachedPage &page = resultSet.pages[request.page];
+    const qint64 size = entriesSize(entries);
+    resultSet.bytes += size - page.bytes;
+    m_requestCacheBytes += size - page.bytes;
+    page.entries = entries;
+    page.bytes = size;
+    page.storedAt = m_clock.elapsed();
+    page.stale = false;
+    resultSet.lastUsed = ++m_useCounter;
+    qCDebug(KNEWSTUFF) << request.hashForRequest() << " add: " << entries.size() << " result sets: " << m_requestCache.size();
+
+    trimRequestCache();
 }
 
 EntryInternal::List Cache::requestFromCache(const KNS3::Provider::SearchRequest &request)
 {
-    qCDebug(KNEWSTUFF) << request.hashForRequest();
-    return requestCache.value(request.hashForRequest());
+    QHash<KNS3::Provider::SearchRequest, CachedResultSet>::iterator resultSet = m_requestCache.find(firstPage(request));
+    if (resultSet == m_requestCache.end()) {
+        ++m_requestCacheStatistics.misses;
+        return EntryInternal::List();
+    }
+    QMap<int, CachedPage>::iterator page = resultSet->pages.find(request.page);
+    if (page == resultSet->pages.end()) {
+        ++m_requestCacheStatistics.misses;
+        return EntryInternal::List();
+    }
+    if (isExpired(*page)) {
+        qCDebug(KNEWSTUFF) << "Expired: " << request.hashForRequest();
+        resultSet->bytes -= page->bytes;
+        m_requestCacheBytes -= page->bytes;
+        resultSet->pages.erase(page);
+        resultSet->lastPage = -1;
+        if (resultSet->pages.isEmpty()) {
+            m_requestCacheBytes -= resultSet->bytes;
+            m_requestCache.erase(resultSet);
+        }
+        m_requestCacheStatistics.bytes = m_requestCacheBytes;
+        ++m_requestCacheStatistics.misses;
+        return EntryInternal::List();
+    }
+
+    resultSet->lastUsed = ++m_useCounter;
+    ++m_requestCacheStatistics.hits;
+    return page->entries;
+}
+
+void Cache::setRequestCacheLimits(qint64 maxBytes, int timeToLive)
+{
+    m_requestCacheMaxBytes = maxBytes;
+    m_requestCacheTimeToLive = timeToLive * qint64(1000);
+    trimRequestCache();
+}
+
+Cache::RequestCacheStatistics Cache::requestCacheStatistics() const
+{
+    return m_requestCacheStatistics;
+}
+
+bool Cache::isStale(const KNS3::Provider::SearchRequest &request) const
+{
+    QHash<KNS3::Provider::SearchRequest, CachedResultSet>::const_iterator resultSet = m_requestCache.constFind(firstPage(request));
+    if (resultSet == m_requestCache.constEnd()) {
+        return false;
+    }
+    return resultSet->pages.value(request.page).stale;
+}
+
+void Cache::readResults()
+{
+    if (m_resultsRead) {
+        return;
+    }
+    m_resultsRead = true;
+
+    QFile f(resultsFile);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    QDataStream stream(&f);
+    stream.setVersion(QDataStream::Qt_5_5);
+
+    quint32 magic, version;
+    QDateTime savedAt;
+    qint32 resultSets;
+    stream >> magic >> version >> savedAt >> resultSets;
+    if (magic != ResultsMagic || version != ResultsVersion || stream.status() != QDataStream::Ok) {
+        return;
+    }
+    if (savedAt.daysTo(QDateTime::currentDateTimeUtc()) > MaximumResultsAge) {
+        qCDebug(KNEWSTUFF) << "Results of the last session are too old";
+        return;
+    }
+
+    const qint64 now = m_clock.elapsed();
+    for (int i = 0; i < resultSets && stream.status() == QDataStream::Ok; ++i) {
+        qint32 sortMode, pageSize, pages;
+        KNS3::Provider::SearchRequest request;
+        stream >> sortMode >> request.searchTerm >> request.categories >> pageSize >> pages;
+        request.sortMode = KNS3::Provider::SortMode(sortMode);
+        request.pageSize = pageSize;
+        request.page = 0;
+
+        // there is no last page: stale pages must neither answer refined searches nor
+        // stop prefetching, the set is complete again once the providers answered
+        CachedResultSet resultSet;
+        for (int p = 0; p < pages && stream.status() == QDataStream::Ok; ++p) {
+            qint32 page;
+            CachedPage cached;
+            stream >> page >> cached.entries;
+            cached.storedAt = now;
+            cached.stale = true;
+            // the registry knows better whether an entry is installed
+            for (int e = 0; e < cached.entries.size(); ++e) {
+                const EntryInternal installed = registryEntry(cached.entries.at(e).providerId(), cached.entries.at(e).uniqueId());
+                if (installed.isValid()) {
+                    cached.entries[e] = installed;
+                } else {
+                    cached.entries[e].setStatus(Entry::Downloadable);
+                }
+            }
+            cached.bytes = entriesSize(cached.entries);
+            resultSet.bytes += cached.bytes;
+            resultSet.pages.insert(page, cached);
+        }
+        if (stream.status() == QDataStream::Ok && !m_requestCache.contains(request)) {
+            m_requestCacheBytes += resultSet.bytes;
+            m_requestCache.insert(request, resultSet);
+        }
+    }
+    qCDebug(KNEWSTUFF) << "Read" << m_requestCache.size() << "result sets of the last session";
+    trimRequestCache();
+}
+
+void Cache::writeResults()
+{
+    if (!m_resultsRead) {
+        // the results of the last session have not been used, keep them
+        return;
+    }
+
+    // the most recently used result sets
+    QList<QHash<KNS3::Provider::SearchRequest, CachedResultSet>::const_iterator> recent;
+    for (QHash<KNS3::Provider::SearchRequest, CachedResultSet>::const_iterator it = m_requestCache.constBegin(); it != m_requestCache.constEnd(); ++it) {
+        if (it.key().sortMode == KNS3::Provider::Installed || it.key().sortMode == KNS3::Provider::Updates) {
+            continue;
+        }
+        recent.append(it);
+    }
+    std::sort(recent.begin(), recent.end(), [](QHash<KNS3::Provider::SearchRequest, CachedResultSet>::const_iterator left,
+                                               QHash<KNS3::Provider::SearchRequest, CachedResultSet>::const_iterator right) {
+        return left->lastUsed > right->lastUsed;
+    });
+    recent = recent.mid(0, PersistedResultSets);
+
+    QSaveFile f(resultsFile);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write results to '" << resultsFile << "'.";
+        return;
+    }
+    QDataStream stream(&f);
+    stream.setVersion(QDataStream::Qt_5_5);
+    stream << ResultsMagic << ResultsVersion << QDateTime::currentDateTimeUtc() << qint32(recent.size());
+    foreach (const auto &it, recent) {
+        QList<int> pages;
+        foreach (int page, it->pages.keys()) {
+            if (page < PersistedPages && !isExpired(it->pages.value(page))) {
+                pages.append(page);
+            }
+        }
+        stream << qint32(it.key().sortMode) << it.key().searchTerm << it.key().categories << qint32(it.key().pageSize)
+               << qint32(pages.size());
+        foreach (int page, pages) {
+            stream << qint32(page) << it->pages.value(page).entries;
+        }
+    }
+    f.commit();
+}
+
+bool Cache::isExpired(const CachedPage &page) const
+{
+    return m_requestCacheTimeToLive > 0 && m_clock.elapsed() - page.storedAt > m_requestCacheTimeToLive;
+}
+
+void Cache::trimRequestCache()
+{
+    QHash<KNS3::Provider::SearchRequest, CachedResultSet>::iterator resultSet = m_requestCache.begin();
+    while (resultSet != m_requestCache.end()) {
+        QMap<int, CachedPage>::iterator page = resultSet->pages.begin();
+        while (page != resultSet->pages.end()) {
+            if (isExpired(*page)) {
+                resultSet->bytes -= page->bytes;
+                m_requestCacheBytes -= page->bytes;
+                page = resultSet->pages.erase(page);
+                resultSet->lastPage = -1;
+                continue;
+            }
+            ++page;
+        }
+        if (resultSet->pages.isEmpty()) {
+            // what is left are the preview images charged to the set
+            m_requestCacheBytes -= resultSet->bytes;
+            resultSet = m_requestCache.erase(resultSet);
+            continue;
+        }
+        ++resultSet;
+    }
+
+    // the most recently used result set is always kept, it is the one being shown
+    while (m_requestCacheMaxBytes > 0 && m_requestCacheBytes > m_requestCacheMaxBytes && m_requestCache.size() > 1) {
+        QHash<KNS3::Provider::SearchRequest, CachedResultSet>::iterator oldest = m_requestCache.begin();
+        for (resultSet = m_requestCache.begin(); resultSet != m_requestCache.end(); ++resultSet) {
+            if (resultSet->lastUsed < oldest->lastUsed) {
+                oldest = resultSet;
+            }
+        }
+        qCDebug(KNEWSTUFF) << "Evicting cached result set" << oldest.key().hashForRequest();
+        m_requestCacheBytes -= oldest->bytes;
+        m_requestCache.erase(oldest);
+        ++m_requestCacheStatistics.evictions;
+    }
+    m_requestCacheStatistics.bytes = m_requestCacheBytes;
+}
+
+void Cache::addPreviewImage(const KNS3::EntryInternal &entry, EntryInternal::PreviewType type)
+{
+    // previews are loaded for the entries being shown, they are part of the most recently used result set
+    QHash<KNS3::Provider::SearchRequest, CachedResultSet>::iterator current = m_requestCache.end();
+    for (QHash<KNS3::Provider::SearchRequest, CachedResultSet>::iterator it = m_requestCache.begin(); it != m_requestCache.end(); ++it) {
+        if (current == m_requestCache.end() || it->lastUsed > current->lastUsed) {
+            current = it;
+        }
+    }
+    if (current == m_requestCache.end()) {
+        return;
+    }
+    Q_UNUSED(type)
+    for (QMap<int, CachedPage>::iterator page = current->pages.begin(); page != current->pages.end(); ++page) {
+        if (page->entries.contains(entry)) {
+            // the entries share their data with the cached copies, measuring the page again counts the image once
+            const qint64 size = entriesSize(page->entries);
+            current->bytes += size - page->bytes;
+            m_requestCacheBytes += size - page->bytes;
+            page->bytes = size;
+            trimRequestCache();
+            return;
+        }
+    }
+}
+
+static bool matchesRequest(const KNS3::Provider::SearchRequest &request, const EntryInternal &entry)
+{
+    if (!request.categories.isEmpty() && !request.categories.contains(entry.category())) {
+        return false;
+    }
+    if (request.searchTerm.isEmpty()) {
+        return true;
+    }
+    return entry.name().contains(request.searchTerm, Qt::CaseInsensitive)
+           || entry.summary().contains(request.searchTerm, Qt::CaseInsensitive)
+           || entry.author().name().contains(request.searchTerm, Qt::CaseInsensitive);
+}
+
+EntryInternal::List Cache::searchLocally(const KNS3::Provider::SearchRequest &request)
+{
+    loadAllProviders();
+
+    QSet<EntryInternal> found;
+    foreach (const auto &entries, m_entriesByProvider) {
+        foreach (const EntryInternal &entry, entries) {
+            if (matchesRequest(request, entry)) {
+                found.insert(entry);
+            }
+        }
+    }
+    foreach (const CachedResultSet &resultSet, m_requestCache) {
+        foreach (const CachedPage &page, resultSet.pages) {
+            if (isExpired(page)) {
+                continue;
+            }
+            foreach (const EntryInternal &entry, page.entries) {
+                if (!found.contains(entry) && matchesRequest(request, entry)) {
+                    found.insert(entry);
+                }
+            }
+        }
+    }
+    qCDebug(KNEWSTUFF) << "Found" << found.size() << "local entries for" << request.searchTerm;
+    return found.toList();
+}
+
+void Cache::markLastPage(const KNS3::Provider::SearchRequest &request)
+{
+    QHash<KNS3::Provider::SearchRequest, CachedResultSet>::iterator resultSet = m_requestCache.find(firstPage(request));
+    if (resultSet != m_requestCache.end()) {
+        resultSet->lastPage = request.page;
+    }
+}
+
+bool Cache::isLastPage(const KNS3::Provider::SearchRequest &request) const
+{
+    QHash<KNS3::Provider::SearchRequest, CachedResultSet>::const_iterator resultSet = m_requestCache.constFind(firstPage(request));
+    return resultSet != m_requestCache.constEnd() && resultSet->lastPage >= 0 && request.page >= resultSet->lastPage;
+}
+
+bool Cache::refineFromCache(const KNS3::Provider::SearchRequest &request, EntryInternal::List &entries)
+{
+    if (request.searchTerm.isEmpty()) {
+        return false;
+    }
+
+    // the most specific complete result set whose search term is contained in the new one,
+    // everything that matches the new term also matches that one
+    QHash<KNS3::Provider::SearchRequest, CachedResultSet>::iterator superset = m_requestCache.end();
+    for (QHash<KNS3::Provider::SearchRequest, CachedResultSet>::iterator it = m_requestCache.begin(); it != m_requestCache.end(); ++it) {
+        const KNS3::Provider::SearchRequest &candidate = it.key();
+        if (it->lastPage < 0 || candidate.sortMode != request.sortMode || candidate.categories != request.categories
+                || candidate.pageSize != request.pageSize
+                || !request.searchTerm.contains(candidate.searchTerm, Qt::CaseInsensitive)) {
+            continue;
+        }
+        if (superset == m_requestCache.end() || candidate.searchTerm.size() > superset.key().searchTerm.size()) {
+            superset = it;
+        }
+    }
+    if (superset == m_requestCache.end()) {
+        return false;
+    }
+
+    entries.clear();
+    for (int page = 0; page <= superset->lastPage; ++page) {
+        QMap<int, CachedPage>::const_iterator cached = superset->pages.constFind(page);
+        if (cached == superset->pages.constEnd() || isExpired(*cached)) {
+            return false;
+        }
+        foreach (const EntryInternal &entry, cached->entries) {
+            if (matchesRequest(request, entry)) {
+                entries.append(entry);
+            }
+        }
+    }
+    superset->lastUsed = ++m_useCounter;
+    ++m_requestCacheStatistics.hits;
+    qCDebug(KNEWSTUFF) << "Refined" << superset.key().searchTerm << "to" << request.searchTerm << ":" << entries.size() << "entries";
+    return true;
 }
 
@@ -19,14 +19,20 @@
 #ifndef CACHE_H
 #define CACHE_H
 
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMap>
 #include <QtCore/QObject>
+#include <QtCore/QScopedPointer>
 #include <QtCore/QSet>
+#include <QtCore/QThreadPool>
 
 #include "engine_p.h"
 #include "entryinternal_p.h"
 
 namespace KNS3
 {
+class RegistryFile;
+class RegistryJournal;
 
 class Cache : public QObject
 {
@@ -38,7 +44,7 @@ public:
      * That way it is made sure, that there do not exist different
      * instances of cache, with different contents
      * @param appName The file name of the registry - this is usually
-     * the application name, it will be stored in "apps/knewstuff3/appname.knsregistry"
+     * the application name, it will be stored in "knewstuff3/appname.knsregistry.bin"
      */
     static QSharedPointer<Cache> getCache(const QString &appName);
 
@@ -48,33 +54,167 @@ public:
     void readRegistry();
     /// All entries that have been installed by a certain provider
     EntryInternal::List registryForProvider(const QString &providerId);
+    /// The registry entry of @p providerId with @p uniqueId, invalid if there is none
+    EntryInternal registryEntry(const QString &providerId, const QString &uniqueId);
+    /// All registry entries with @p status
+    EntryInternal::List entriesWithStatus(Entry::Status status);
 
-    /// Save the list of installed entries
-    void writeRegistry();
+    /**
+     * Fold the journal of changes into the registry file.
+     * Changes are on disk as soon as they are registered, this only keeps the journal short.
+     * The file is written in the background.
+     */
+    void compactRegistry();
 
+    /// Store a page of results, a page that was stored before is replaced
     void insertRequest(const KNS3::Provider::SearchRequest &, const KNS3::EntryInternal::List &entries);
     EntryInternal::List requestFromCache(const KNS3::Provider::SearchRequest &);
 
+    /**
+     * Limit the cached requests. When the entries of all cached result sets (including their
+     * preview images) need more than @p maxBytes, the least recently used result sets are dropped.
+     * Pages older than @p timeToLive seconds are not used anymore.
+     * 0 means no limit.
+     */
+    void setRequestCacheLimits(qint64 maxBytes, int timeToLive);
+
+    struct RequestCacheStatistics {
+        RequestCacheStatistics() : hits(0), misses(0), evictions(0), bytes(0) {}
+        quint64 hits;
+        quint64 misses;
+        // result sets dropped to stay within the size limit
+        quint64 evictions;
+        // size of the cached entries
+        qint64 bytes;
+    };
+    RequestCacheStatistics requestCacheStatistics() const;
+
+    /**
+     * A preview image of @p entry was loaded. The cached copies of the entry share it,
+     * so the cached page the entry is shown from is measured again.
+     */
+    void addPreviewImage(const KNS3::EntryInternal &entry, EntryInternal::PreviewType type);
+
+    /**
+     * Load the result pages kept from an earlier session. They can be shown right away,
+     * but are stale until the providers answered the request again.
+     * The most recently used result sets are saved when the cache is destroyed.
+     */
+    void readResults();
+    /// Whether the cached page of @p request comes from an earlier session
+    bool isStale(const KNS3::Provider::SearchRequest &request) const;
+
+    /**
+     * All entries known locally (installed entries and the results of earlier requests)
+     * that match the search term and categories of @p request, in no particular order.
+     */
+    EntryInternal::List searchLocally(const KNS3::Provider::SearchRequest &request);
+
+    /**
+     * Remember that @p request returned the last page of its result set,
+     * so all pages up to this one are in the cache.
+     */
+    void markLastPage(const KNS3::Provider::SearchRequest &request);
+    /// Whether @p request is known to be the last page (or beyond) of its result set
+    bool isLastPage(const KNS3::Provider::SearchRequest &request) const;
+
+    /**
+     * Answer @p request locally by filtering a complete result set of a shorter search term
+     * with the same sort mode and categories.
+     * @param entries the matching entries of all pages, in the order of the result set
+     * @return false if there is no complete result set the request refines
+     */
+    bool refineFromCache(const KNS3::Provider::SearchRequest &request, EntryInternal::List &entries);
+
 public Q_SLOTS:
     void registerChangedEntry(const KNS3::EntryInternal &entry);
 
+private Q_SLOTS:
+    void compactionFinished();
+
 private:
     Q_DISABLE_COPY(Cache)
     Cache(const QString &appName);
 
     // compatibility with KNS2
     void readKns2MetaFiles();
+    // the XML registry of earlier versions, still written as a debugging aid
+    void readXmlRegistry();
+    void writeXmlRegistry(const EntryInternal::List &entries);
+
+    // decode the entries of a provider from the mapped registry
+    void loadProvider(const QString &providerId);
+    void loadAllProviders();
+
+    // the pages of one result set, keyed by the request for its first page
+    struct CachedPage {
+        CachedPage() : bytes(0), storedAt(0), stale(false) {}
+        EntryInternal::List entries;
+        // size of the entries, including the preview images loaded for them
+        qint64 bytes;
+        qint64 storedAt;
+        bool stale;
+    };
+    struct CachedResultSet {
+        CachedResultSet() : lastPage(-1), lastUsed(0), bytes(0) {}
+        QMap<int, CachedPage> pages;
+        // the last page of the result set if all pages up to it are cached, -1 otherwise
+        int lastPage;
+        quint64 lastUsed;
+        // size of the pages
+        qint64 bytes;
+    };
+    bool isExpired(const CachedPage &page) const;
+    // drop expired pages and least recently used result sets until the cache fits its budget
+    void trimRequestCache();
+    void writeResults();
+
+    // keep the indexes up to date
+    bool containsEntry(const EntryInternal &entry) const;
+    void insertEntry(const EntryInternal &entry);
+    void removeEntry(const EntryInternal &entry);
+    // apply the records of a journal to the entries in memory
+    int replayJournal(RegistryJournal *journal);
 
 private:
     // The file that is used to keep track of downloaded entries
+    QString binaryRegistryFile;
+    QScopedPointer<RegistryFile> m_registry;
+    // providers whose entries have not been decoded from the registry yet
+    QSet<QString> m_pendingProviders;
+    // changes since the registry file was written
+    QScopedPointer<RegistryJournal> m_journal;
+    // the journal that is being folded into the registry file
+    QString compactingJournalFile;
+    // hash of the record on disk for an entry, changes that do not alter it are not journaled
+    QHash<EntryInternal, uint> m_journaled;
+    // entries removed by the journal, their record in the registry file is outdated
+    QSet<EntryInternal> m_journalRemoved;
+    QThreadPool m_compactionPool;
+    bool m_compacting;
+    // The XML registry, read once for migration and written when debugging
     QString registryFile;
 
     // The component name that was used in KNS2 to keep track of .meta files
     // This is only for compatibility with the former version - KNewStuff2.
     QString m_kns2ComponentName;
 
-    QSet<EntryInternal> cache;
-    QHash<QString, EntryInternal::List> requestCache;
+    // providerId -> uniqueId -> entry
+    QHash<QString, QHash<QString, EntryInternal> > m_entriesByProvider;
+    // status at the time the entry was registered -> entries
+    QHash<int, QSet<EntryInternal> > m_entriesByStatus;
+    QHash<KNS3::Provider::SearchRequest, CachedResultSet> m_requestCache;
+    QElapsedTimer m_clock;
+    quint64 m_useCounter;
+    // size of all cached result sets, kept up to date as pages come and go
+    qint64 m_requestCacheBytes;
+    qint64 m_requestCacheMaxBytes;
+    // in ms
+    qint64 m_requestCacheTimeToLive;
+    RequestCacheStatistics m_requestCacheStatistics;
+    // result pages kept across sessions
+    QString resultsFile;
+    bool m_resultsRead;
 };
 
 }
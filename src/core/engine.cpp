@@ -34,6 +34,7 @@
 #include <QDesktopServices>
 
 #include <QtCore/QTimer>
+#include <algorithm>
 #include <QtCore/QDir>
 #include <QtXml/qdom.h>
 #include <QUrlQuery>
@@ -50,36 +51,48 @@
 // own
 #include "attica/atticaprovider_p.h"
 #include "core/cache_p.h"
+#include "staticxml/localdirectoryprovider_p.h"
 #include "staticxml/staticxmlprovider_p.h"
 
 using namespace KNS3;
 
+// bounds of the delay between the last keystroke and the search request sent to the providers
+static const int MinimumSearchDelay = 150;
+static const int MaximumSearchDelay = 1000;
+
 Engine::Engine(QObject *parent)
     : QObject(parent)
     , m_installation(new Installation)
     , m_cache(0)
     , m_searchTimer(new QTimer)
+    , m_revalidationFailed(false)
+    , m_lastKeystroke(-1)
+    , m_typingInterval(300)
+    , m_providerLatency(0)
     , m_atticaProviderManager(0)
     , m_currentPage(-1)
     , m_pageSize(20)
-    , m_numDataJobs(0)
-    , m_numPictureJobs(0)
-    , m_numInstallJobs(0)
+    , m_prefetchPages(1)
+    , m_prefetchMaxRequests(4)
+    , m_prefetchMaxBytes(2 * 1024 * 1024)
+    , m_feedMaxAge(0)
+    , m_scheduler(new JobScheduler(this))
+    , m_pendingUpdateChecks(0)
+    , m_interactive(true)
     , m_initialized(false)
 {
     m_searchTimer->setSingleShot(true);
-    m_searchTimer->setInterval(1000);
+    m_searchTimer->setInterval(MaximumSearchDelay);
     connect(m_searchTimer, &QTimer::timeout, this, &Engine::slotSearchTimerExpired);
     connect(m_installation, &Installation::signalInstallationFinished, this, &Engine::slotInstallationFinished);
     connect(m_installation, &Installation::signalInstallationFailed, this, &Engine::slotInstallationFailed);
-
+    connect(m_scheduler, &JobScheduler::statusChanged, this, &Engine::updateStatus);
+    m_clock.start();
 }
 
 Engine::~Engine()
 {
-    if (m_cache) {
-        m_cache->writeRegistry();
-    }
+    // the cache journals every change of the registry, there is nothing left to write
     delete m_atticaProviderManager;
     delete m_searchTimer;
     delete m_installation;
@@ -113,6 +126,12 @@ bool Engine::init(const QString &configfile)
 
     m_categories = group.readEntry("Categories", QStringList());
 
+    // load pages ahead of time, bounded by a request and a size budget
+    m_prefetchPages = qBound(0, group.readEntry("PrefetchPages", m_prefetchPages), 2);
+    m_prefetchMaxRequests = qMax(0, group.readEntry("PrefetchMaxRequests", m_prefetchMaxRequests));
+    m_prefetchMaxBytes = qMax(0, group.readEntry("PrefetchMaxSize", int(m_prefetchMaxBytes / 1024))) * qint64(1024);
+    m_feedMaxAge = qMax(0, group.readEntry("FeedMaxAge", m_feedMaxAge));
+
     qCDebug(KNEWSTUFF) << "Categories: " << m_categories;
     m_providerFileUrl = group.readEntry("ProvidersUrl", QString());
     m_applicationName = QFileInfo(QStandardPaths::locate(QStandardPaths::GenericConfigLocation, configfile)).baseName() + ':';
@@ -126,7 +145,11 @@ bool Engine::init(const QString &configfile)
 
     m_cache = Cache::getCache(m_applicationName.split(':')[0]);
     connect(this, &Engine::signalEntryChanged, m_cache.data(), &Cache::registerChangedEntry);
+    // results of earlier requests are kept within a size budget (KiB) and for a limited time (s)
+    m_cache->setRequestCacheLimits(qMax(0, group.readEntry("RequestCacheSize", 16384)) * qint64(1024),
+                                   qMax(0, group.readEntry("RequestCacheTTL", 1800)));
     m_cache->readRegistry();
+    m_cache->readResults();
 
     m_initialized = true;
 
@@ -163,6 +186,7 @@ void Engine::loadProviders()
         connect(loader, &XmlLoader::signalLoaded, this, &Engine::slotProviderFileLoaded);
         connect(loader, &XmlLoader::signalFailed, this, &Engine::slotProvidersFailed);
 
+        loader->setMaxAge(m_feedMaxAge);
         loader->load(QUrl(m_providerFileUrl));
     }
 }
@@ -191,8 +215,12 @@ void Engine::slotProviderFileLoaded(const QDomDocument &doc)
         QSharedPointer<KNS3::Provider> provider;
         if (isAtticaProviderFile || n.attribute(QStringLiteral("type")).toLower() == QLatin1String("rest")) {
             provider = QSharedPointer<KNS3::Provider> (new AtticaProvider(m_categories));
+        } else if (n.attribute(QStringLiteral("type")).toLower() == QLatin1String("directory")) {
+            provider = QSharedPointer<KNS3::Provider> (new LocalDirectoryProvider);
         } else {
-            provider = QSharedPointer<KNS3::Provider> (new StaticXmlProvider);
+            StaticXmlProvider *staticProvider = new StaticXmlProvider;
+            staticProvider->setFeedMaxAge(m_feedMaxAge);
+            provider = QSharedPointer<KNS3::Provider> (staticProvider);
         }
 
         if (provider->setProviderXML(n)) {
@@ -221,11 +249,17 @@ void Engine::addProvider(QSharedPointer<KNS3::Provider> provider)
 {
     qCDebug(KNEWSTUFF) << "Engine addProvider called with provider with id " << provider->id();
     m_providers.insert(provider->id(), provider);
+    provider->setInteractive(m_interactive);
     connect(provider.data(), &Provider::providerInitialized, this, &Engine::providerInitialized);
     connect(provider.data(), SIGNAL(loadingFinished(KNS3::Provider::SearchRequest,KNS3::EntryInternal::List)),
             SLOT(slotEntriesLoaded(KNS3::Provider::SearchRequest,KNS3::EntryInternal::List)));
+    connect(provider.data(), SIGNAL(loadingProgress(KNS3::Provider::SearchRequest,KNS3::EntryInternal::List)),
+            SLOT(slotEntriesProgress(KNS3::Provider::SearchRequest,KNS3::EntryInternal::List)));
+    connect(provider.data(), SIGNAL(loadingFailed(KNS3::Provider::SearchRequest)),
+            SLOT(slotEntriesFailed(KNS3::Provider::SearchRequest)));
     connect(provider.data(), &Provider::entryDetailsLoaded, this, &Engine::slotEntryDetailsLoaded);
     connect(provider.data(), &Provider::payloadLinkLoaded, this, &Engine::downloadLinkLoaded);
+    connect(provider.data(), &Provider::payloadLinkFailed, this, &Engine::downloadLinkFailed);
     connect(provider.data(), &Provider::signalError, this, &Engine::signalError);
     connect(provider.data(), &Provider::signalInformation, this, &Engine::signalIdle);
 }
@@ -256,60 +290,222 @@ void Engine::providerInitialized(Provider *p)
 
 void Engine::slotEntriesLoaded(const KNS3::Provider::SearchRequest &request, KNS3::EntryInternal::List entries)
 {
-    m_currentPage = qMax<int>(request.page, m_currentPage);
-    qCDebug(KNEWSTUFF) << "loaded page " << request.page << "current page" << m_currentPage;
-
+    Provider *provider = qobject_cast<Provider *>(sender());
     if (request.sortMode == Provider::Updates) {
+        if (provider) {
+            m_scheduler->finished(m_updateCheckTickets.take(provider->id()));
+        }
         emit signalUpdateableEntriesLoaded(entries);
+        if (provider) {
+            updateCheckFinished();
+        }
+    } else if (provider) {
+        requestFinished(request, provider->id());
+        addProviderResults(request, provider->id(), entries);
+    }
+}
+
+void Engine::slotEntriesProgress(const KNS3::Provider::SearchRequest &request, const KNS3::EntryInternal::List &entries)
+{
+    if (request != m_currentRequest || m_prefetchRequests.contains(request) || !m_merger.isPending(request)
+            || request.sortMode == Provider::Installed || request.sortMode == Provider::Updates) {
+        return;
+    }
+    // shown like the results of a local search, the complete page refreshes them in place
+    EntryInternal::List newEntries;
+    foreach (const EntryInternal &entry, entries) {
+        if (!m_localResults.contains(entry)) {
+            m_localResults.insert(entry);
+            newEntries.append(entry);
+        }
+    }
+    if (!newEntries.isEmpty()) {
+        emit signalEntriesLoaded(newEntries);
+    }
+}
+
+void Engine::slotEntriesFailed(const KNS3::Provider::SearchRequest &request)
+{
+    Provider *provider = qobject_cast<Provider *>(sender());
+    if (!provider) {
+        return;
+    }
+    if (request.sortMode == Provider::Updates) {
+        m_scheduler->finished(m_updateCheckTickets.take(provider->id()));
+        updateCheckFinished();
     } else {
-        m_cache->insertRequest(request, entries);
+        if (m_revalidatedPages.contains(request)) {
+            // the entries of this provider cannot be told apart from removed ones
+            m_revalidationFailed = true;
+        }
+        // a failing provider must not hold back the results of the others
+        requestFinished(request, provider->id());
+        if (m_merger.addFailure(request, provider->id())) {
+            pageCompleted(request);
+        }
+    }
+}
+
+void Engine::addProviderResults(const Provider::SearchRequest &request, const QString &providerId, const EntryInternal::List &entries)
+{
+    if (m_merger.addResults(request, providerId, entries)) {
+        pageCompleted(request);
+    }
+}
+
+void Engine::pageCompleted(const Provider::SearchRequest &request)
+{
+    // without the entries of a failed provider the page is shown, but it is not
+    // a complete result: caching it would answer later requests and refinements wrongly
+    const bool failed = m_merger.hasFailures(request);
+    const bool lastPage = !m_merger.hasMorePages(request);
+    const EntryInternal::List page = m_merger.takePage(request);
+    if (request.sortMode != Provider::Installed && !failed) {
+        m_cache->insertRequest(request, page);
+        if (lastPage) {
+            m_cache->markLastPage(request);
+        }
+    }
+
+    if (m_prefetchRequests.remove(request)) {
+        // a speculative page, only show it if the view asked for it in the meantime
+        if (request != m_currentRequest || m_currentPage >= request.page) {
+            qCDebug(KNEWSTUFF) << "prefetched page " << request.page;
+            qint64 bytes = 0;
+            foreach (const EntryInternal &entry, page) {
+                bytes += entry.approximateSize();
+            }
+            m_prefetchedPages.insert(request, bytes);
+            // an empty page cannot be told apart from an expired one in the cache, keep it here
+            if (failed || page.isEmpty()) {
+                m_incompletePages.insert(request, page);
+            }
+            return;
+        }
+    }
+    showPage(request, page);
+}
+
+void Engine::showPage(const Provider::SearchRequest &request, const EntryInternal::List &entries)
+{
+    m_prefetchedPages.remove(request);
+    m_incompletePages.remove(request);
+    m_currentPage = qMax<int>(request.page, m_currentPage);
+    qCDebug(KNEWSTUFF) << "loaded page " << request.page << "current page" << m_currentPage;
+
+    if (m_localResults.isEmpty()) {
         emit signalEntriesLoaded(entries);
+    } else {
+        // the local search already showed some of these, only refresh them
+        EntryInternal::List newEntries;
+        foreach (const EntryInternal &entry, entries) {
+            if (m_localResults.contains(entry)) {
+                emit signalEntryChanged(entry);
+            } else {
+                newEntries.append(entry);
+            }
+        }
+        emit signalEntriesLoaded(newEntries);
+    }
+    emit signalPageLoaded(entries);
+    if (m_revalidatedPages.remove(request)) {
+        m_freshResults.unite(entries.toSet());
+        if (m_revalidatedPages.isEmpty()) {
+            finishRevalidation();
+        }
     }
+    prefetchAfter(request, entries);
+}
 
-    --m_numDataJobs;
-    updateStatus();
+void Engine::prefetchAfter(const Provider::SearchRequest &request, const EntryInternal::List &entries)
+{
+    if (request.sortMode == Provider::Installed || request.sortMode == Provider::Updates) {
+        return;
+    }
+    // a short page means the providers have nothing more to offer
+    if (entries.size() < request.pageSize || m_cache->isLastPage(request)) {
+        return;
+    }
+
+    qint64 waitingBytes = 0;
+    foreach (qint64 bytes, m_prefetchedPages) {
+        waitingBytes += bytes;
+    }
+
+    Provider::SearchRequest next = request;
+    for (int i = 0; i < m_prefetchPages; ++i) {
+        ++next.page;
+        if (m_prefetchRequests.contains(next) || m_prefetchedPages.contains(next)
+                || !m_cache->requestFromCache(next).isEmpty()) {
+            continue;
+        }
+        if (m_prefetchRequests.size() + m_prefetchedPages.size() >= m_prefetchMaxRequests
+                || waitingBytes >= m_prefetchMaxBytes) {
+            qCDebug(KNEWSTUFF) << "prefetch budget exhausted";
+            return;
+        }
+        qCDebug(KNEWSTUFF) << "prefetching page " << next.page;
+        m_prefetchRequests.insert(next);
+        sendRequest(next);
+    }
 }
 
 void Engine::reloadEntries()
 {
+    // the view shows the results of an earlier session for this request, refresh them in place
+    Provider::SearchRequest firstPage = m_currentRequest;
+    firstPage.page = 0;
+    if (!m_staleResults.isEmpty() && m_staleRequest == firstPage) {
+        revalidateResults();
+        return;
+    }
+
     emit signalResetView();
+    abortStaleWork();
+    m_merger.reset();
+    m_prefetchRequests.clear();
+    m_prefetchedPages.clear();
+    m_incompletePages.clear();
+    m_localResults.clear();
+    m_staleResults.clear();
+    m_revalidatedPages.clear();
     m_currentPage = -1;
     m_currentRequest.page = 0;
-    m_numDataJobs = 0;
-
-    foreach (const QSharedPointer<KNS3::Provider> &p, m_providers) {
-        if (p->isInitialized()) {
-            if (m_currentRequest.sortMode == Provider::Installed) {
-                // when asking for installed entries, never use the cache
-                p->loadEntries(m_currentRequest);
-            } else {
-                // take entries from cache until there are no more
-                EntryInternal::List cache = m_cache->requestFromCache(m_currentRequest);
-                while (!cache.isEmpty()) {
-                    qCDebug(KNEWSTUFF) << "From cache";
-                    emit signalEntriesLoaded(cache);
-
-                    m_currentPage = m_currentRequest.page;
-                    ++m_currentRequest.page;
-                    cache = m_cache->requestFromCache(m_currentRequest);
-                }
 
-                // Since the cache has no more pages, reset the request's page
-                if (m_currentPage >= 0) {
-                    m_currentRequest.page = m_currentPage;
-                }
+    if (m_currentRequest.sortMode != Provider::Installed) {
+        // take entries from cache until there are no more,
+        // when asking for installed entries, never use the cache
+        EntryInternal::List cache = m_cache->requestFromCache(m_currentRequest);
+        while (!cache.isEmpty()) {
+            qCDebug(KNEWSTUFF) << "From cache";
+            if (m_cache->isStale(m_currentRequest)) {
+                m_staleResults.unite(cache.toSet());
+            }
+            m_merger.markSeen(cache);
+            emit signalEntriesLoaded(cache);
+            emit signalPageLoaded(cache);
 
-                // if the cache was empty, request data from provider
-                if (m_currentPage == -1) {
-                    qCDebug(KNEWSTUFF) << "From provider";
-                    p->loadEntries(m_currentRequest);
+            m_currentPage = m_currentRequest.page;
+            ++m_currentRequest.page;
+            cache = m_cache->requestFromCache(m_currentRequest);
+        }
 
-                    ++m_numDataJobs;
-                    updateStatus();
-                }
+        // Since the cache has no more pages, reset the request's page
+        if (m_currentPage >= 0) {
+            m_currentRequest.page = m_currentPage;
+            if (!m_staleResults.isEmpty()) {
+                m_staleRequest = firstPage;
+                revalidateResults();
+                return;
             }
+            prefetchAfter(m_currentRequest, m_cache->requestFromCache(m_currentRequest));
+            return;
         }
     }
+
+    // if the cache was empty, request data from providers
+    qCDebug(KNEWSTUFF) << "From provider";
+    doRequest();
 }
 
 void Engine::setCategoriesFilter(const QStringList &categories)
@@ -330,20 +526,143 @@ void Engine::setSortMode(Provider::SortMode mode)
 void Engine::setSearchTerm(const QString &searchString)
 {
     m_searchTimer->stop();
+
+    // keep track of the typing speed, pauses longer than the maximum delay start a new burst
+    const qint64 now = m_clock.elapsed();
+    if (m_lastKeystroke >= 0 && now - m_lastKeystroke < MaximumSearchDelay) {
+        m_typingInterval = (3 * m_typingInterval + int(now - m_lastKeystroke)) / 4;
+    }
+    m_lastKeystroke = now;
+
     m_currentRequest.searchTerm = searchString;
     EntryInternal::List cache = m_cache->requestFromCache(m_currentRequest);
     if (!cache.isEmpty()) {
         reloadEntries();
-    } else {
-        m_searchTimer->start();
+        return;
     }
+
+    // a complete result set for a shorter term contains everything the providers could find
+    EntryInternal::List refined;
+    if (m_cache->refineFromCache(m_currentRequest, refined)) {
+        showRefinedResults(refined);
+        return;
+    }
+
+    showLocalResults();
+    m_searchTimer->start(searchDelay());
 }
 
-void Engine::slotSearchTimerExpired()
+void Engine::showRefinedResults(const EntryInternal::List &entries)
 {
+    // cache them like a provider answer, so paging and searching again work as usual
+    Provider::SearchRequest request = m_currentRequest;
+    for (request.page = 0; request.page * request.pageSize < entries.size(); ++request.page) {
+        m_cache->insertRequest(request, entries.mid(request.page * request.pageSize, request.pageSize));
+    }
+    if (entries.isEmpty()) {
+        // nothing to page through, but there is no need to ask the providers either
+        showLocalResults();
+        return;
+    }
+    --request.page;
+    m_cache->markLastPage(request);
     reloadEntries();
 }
 
+void Engine::slotSearchTimerExpired()
+{
+    // refine the local results with the answers of the providers, without resetting the view
+    qCDebug(KNEWSTUFF) << "From provider";
+    m_currentPage = -1;
+    m_currentRequest.page = 0;
+    doRequest();
+}
+
+void Engine::showLocalResults()
+{
+    emit signalResetView();
+    abortStaleWork();
+    m_merger.reset();
+    m_prefetchRequests.clear();
+    m_prefetchedPages.clear();
+    m_incompletePages.clear();
+    m_staleResults.clear();
+    m_revalidatedPages.clear();
+    m_currentPage = -1;
+    m_currentRequest.page = 0;
+
+    EntryInternal::List entries = m_cache->searchLocally(m_currentRequest);
+    if (m_currentRequest.sortMode == Provider::Installed) {
+        EntryInternal::List installed;
+        foreach (const EntryInternal &entry, entries) {
+            if (entry.status() == Entry::Installed || entry.status() == Entry::Updateable) {
+                installed.append(entry);
+            }
+        }
+        entries = installed;
+    }
+    const Provider::SortMode sortMode = m_currentRequest.sortMode;
+    std::stable_sort(entries.begin(), entries.end(), [sortMode](const EntryInternal &left, const EntryInternal &right) {
+        return ResultMerger::lessThan(sortMode, left, right);
+    });
+
+    // not marked as seen in the merger: the provider pages stay complete for the cache,
+    // showPage() only refreshes the entries that are already shown
+    m_localResults = entries.toSet();
+    emit signalEntriesLoaded(entries);
+}
+
+void Engine::revalidateResults()
+{
+    // without the providers there is nothing to compare with, this is called again once they are loaded
+    if (m_providers.isEmpty()) {
+        return;
+    }
+    foreach (const QSharedPointer<KNS3::Provider> &p, m_providers) {
+        if (!p->isInitialized()) {
+            return;
+        }
+    }
+
+    qCDebug(KNEWSTUFF) << "Refreshing" << m_staleResults.size() << "entries of an earlier session";
+    // the view keeps showing the stale entries, the answers of the providers update them in place
+    m_merger.reset();
+    m_localResults = m_staleResults;
+    m_revalidatedEntries = m_staleResults;
+    m_staleResults.clear();
+    m_freshResults.clear();
+    m_revalidationFailed = false;
+
+    Provider::SearchRequest request = m_currentRequest;
+    for (request.page = 0; request.page <= m_currentPage; ++request.page) {
+        m_revalidatedPages.insert(request);
+    }
+    for (request.page = 0; request.page <= m_currentPage; ++request.page) {
+        sendRequest(request);
+    }
+}
+
+void Engine::finishRevalidation()
+{
+    if (!m_revalidationFailed) {
+        foreach (const EntryInternal &entry, m_revalidatedEntries) {
+            if (!m_freshResults.contains(entry)) {
+                emit signalEntryRemoved(entry);
+            }
+        }
+    }
+    m_revalidatedEntries.clear();
+    m_freshResults.clear();
+}
+
+int Engine::searchDelay() const
+{
+    // send the request once the user pauses, which takes a bit longer than the usual
+    // gap between keystrokes. Slow providers make a superfluous request more expensive.
+    const int delay = qMax(m_typingInterval * 3 / 2, m_providerLatency / 4);
+    return qBound(MinimumSearchDelay, delay, MaximumSearchDelay);
+}
+
 void Engine::requestMoreData()
 {
     qCDebug(KNEWSTUFF) << "Get more data! current page: " << m_currentPage  << " requested: " << m_currentRequest.page;
@@ -352,12 +671,41 @@ void Engine::requestMoreData()
         return;
     }
 
+    if (m_cache->isLastPage(m_currentRequest)) {
+        return;
+    }
     m_currentRequest.page++;
+
+    if (m_currentRequest.sortMode != Provider::Installed) {
+        // the page might have been prefetched already
+        const bool kept = m_incompletePages.contains(m_currentRequest);
+        const EntryInternal::List cache = kept ? m_incompletePages.value(m_currentRequest)
+                                          : m_cache->requestFromCache(m_currentRequest);
+        if (kept || !cache.isEmpty()) {
+            m_merger.markSeen(cache);
+            showPage(m_currentRequest, cache);
+            return;
+        }
+        // the prefetched page expired or was dropped from the cache, it is requested again
+        m_prefetchedPages.remove(m_currentRequest);
+        // or it is still on its way, then it will be shown when it arrives
+        if (m_prefetchRequests.contains(m_currentRequest)) {
+            return;
+        }
+    }
     doRequest();
 }
 
 void Engine::requestData(int page, int pageSize)
 {
+    if (page == 0) {
+        // a new search starts, entries may be shown again
+        m_searchTimer->stop();
+        m_merger.reset();
+        m_localResults.clear();
+        m_staleResults.clear();
+        m_revalidatedPages.clear();
+    }
     m_currentRequest.page = page;
     m_currentRequest.pageSize = pageSize;
     doRequest();
@@ -365,11 +713,91 @@ void Engine::requestData(int page, int pageSize)
 
 void Engine::doRequest()
 {
+    sendRequest(m_currentRequest);
+}
+
+void Engine::sendRequest(const Provider::SearchRequest &request)
+{
+    // register all providers first, some of them answer synchronously
+    QList<QSharedPointer<KNS3::Provider> > providers;
     foreach (const QSharedPointer<KNS3::Provider> &p, m_providers) {
-        if (p->isInitialized()) {
-            p->loadEntries(m_currentRequest);
-            ++m_numDataJobs;
-            updateStatus();
+        if (!p->isInitialized()) {
+            continue;
+        }
+        m_merger.expect(request, p->id());
+
+        // the answer to a request that is already on the wire will be used for this one as well
+        QHash<QString, int> &inFlight = m_requestsInFlight[request];
+        if (inFlight.contains(p->id())) {
+            qCDebug(KNEWSTUFF) << "Joining request in flight" << request.hashForRequest() << p->id();
+            continue;
+        }
+        inFlight.insert(p->id(), 0);
+        providers.append(p);
+    }
+    if (!providers.isEmpty() && !m_requestStarted.contains(request)) {
+        m_requestStarted.insert(request, m_clock.elapsed());
+    }
+
+    // the page that is waited for goes before pages that are loaded ahead
+    const int priority = m_prefetchRequests.contains(request) ? 0 : 1;
+    foreach (const QSharedPointer<KNS3::Provider> &p, providers) {
+        const int ticket = m_scheduler->schedule(JobScheduler::Metadata, QString(), priority, [this, p, request](int ticket) {
+            m_requestsInFlight[request].insert(p->id(), ticket);
+            p->loadEntries(request);
+        });
+        // remember the ticket while the job is queued, so it can be cancelled
+        QHash<Provider::SearchRequest, QHash<QString, int> >::iterator it = m_requestsInFlight.find(request);
+        if (it != m_requestsInFlight.end() && it->contains(p->id())) {
+            it->insert(p->id(), ticket);
+        }
+    }
+}
+
+void Engine::abortStaleWork()
+{
+    // the previews belong to entries that are not shown anymore
+    m_scheduler->cancelQueued(JobScheduler::Preview);
+    foreach (ImageLoader *loader, m_imageLoaders) {
+        loader->abort();
+    }
+
+    QHash<Provider::SearchRequest, QHash<QString, int> >::iterator it = m_requestsInFlight.begin();
+    while (it != m_requestsInFlight.end()) {
+        // pages of the current request are still useful, another page of it will be requested anyway
+        Provider::SearchRequest request = it.key();
+        request.page = m_currentRequest.page;
+        if (request == m_currentRequest) {
+            ++it;
+            continue;
+        }
+
+        qCDebug(KNEWSTUFF) << "Aborting request" << it.key().hashForRequest();
+        for (QHash<QString, int>::const_iterator provider = it->constBegin(); provider != it->constEnd(); ++provider) {
+            if (!m_scheduler->cancel(provider.value())) {
+                QSharedPointer<Provider> p = m_providers.value(provider.key());
+                if (p) {
+                    p->abortRequest(it.key());
+                }
+                m_scheduler->finished(provider.value());
+            }
+        }
+        m_requestStarted.remove(it.key());
+        it = m_requestsInFlight.erase(it);
+    }
+}
+
+void Engine::requestFinished(const Provider::SearchRequest &request, const QString &providerId)
+{
+    QHash<Provider::SearchRequest, QHash<QString, int> >::iterator it = m_requestsInFlight.find(request);
+    if (it != m_requestsInFlight.end()) {
+        m_scheduler->finished(it->take(providerId));
+        if (it->isEmpty()) {
+            m_requestsInFlight.erase(it);
+            if (m_requestStarted.contains(request)) {
+                const int latency = int(m_clock.elapsed() - m_requestStarted.take(request));
+                m_providerLatency = m_providerLatency == 0 ? latency : (3 * m_providerLatency + latency) / 4;
+            }
         }
     }
 }
@@ -387,22 +815,30 @@ void Engine::install(KNS3::EntryInternal entry, int linkId)
        << " from: " << entry.providerId();
     QSharedPointer<Provider> p = m_providers.value(entry.providerId());
     if (p) {
-        p->loadPayloadLink(entry, linkId);
-
-        ++m_numInstallJobs;
-        updateStatus();
+        m_scheduler->schedule(JobScheduler::Payload, QUrl(entry.payload()).host(), 0, [this, p, entry, linkId](int ticket) {
+            if (m_installTickets.contains(entry)) {
+                // installed twice in a row, the earlier installation keeps the slot
+                m_scheduler->finished(ticket);
+                return;
+            }
+            m_installTickets.insert(entry, ticket);
+            p->loadPayloadLink(entry, linkId);
+        });
     }
 }
 
-void Engine::slotInstallationFinished()
+void Engine::slotInstallationFinished(const KNS3::EntryInternal &entry)
 {
-    --m_numInstallJobs;
-    updateStatus();
+    if (m_installTickets.contains(entry)) {
+        m_scheduler->finished(m_installTickets.take(entry));
+    }
 }
 
-void Engine::slotInstallationFailed(const QString &message)
+void Engine::slotInstallationFailed(const QString &message, const KNS3::EntryInternal &entry)
 {
-    --m_numInstallJobs;
+    if (m_installTickets.contains(entry)) {
+        m_scheduler->finished(m_installTickets.take(entry));
+    }
     emit signalError(message);
 }
 
@@ -416,18 +852,26 @@ void Engine::downloadLinkLoaded(const KNS3::EntryInternal &entry)
     m_installation->install(entry);
 }
 
+void Engine::downloadLinkFailed(const KNS3::EntryInternal &entry)
+{
+    if (m_installTickets.contains(entry)) {
+        m_scheduler->finished(m_installTickets.take(entry));
+    }
+    // the installation did not start, the entry is in the state it had before
+    EntryInternal unchanged = entry;
+    if (unchanged.status() == Entry::Installing) {
+        unchanged.setStatus(Entry::Downloadable);
+    } else if (unchanged.status() == Entry::Updating) {
+        unchanged.setStatus(Entry::Updateable);
+    }
+    emit signalEntryChanged(unchanged);
+}
+
 void Engine::uninstall(KNS3::EntryInternal entry)
 {
-    KNS3::EntryInternal::List list = m_cache->registryForProvider(entry.providerId());
     //we have to use the cached entry here, not the entry from the provider
     //since that does not contain the list of installed files
-    KNS3::EntryInternal actualEntryForUninstall;
-    foreach (const KNS3::EntryInternal &eInt, list) {
-        if (eInt.uniqueId() == entry.uniqueId()) {
-            actualEntryForUninstall = eInt;
-            break;
-        }
-    }
+    KNS3::EntryInternal actualEntryForUninstall = m_cache->registryEntry(entry.providerId(), entry.uniqueId());
     if (!actualEntryForUninstall.isValid()) {
         qCDebug(KNEWSTUFF) << "could not find a cached entry with following id:" << entry.uniqueId() <<
                  " ->  using the non-cached version";
@@ -447,6 +891,15 @@ void Engine::uninstall(KNS3::EntryInternal entry)
 
 }
 
+void Engine::setInteractive(bool interactive)
+{
+    m_interactive = interactive;
+    m_installation->setInteractive(interactive);
+    foreach (const QSharedPointer<Provider> &p, m_providers) {
+        p->setInteractive(interactive);
+    }
+}
+
 void Engine::loadDetails(const KNS3::EntryInternal &entry)
 {
     QSharedPointer<Provider> p = m_providers.value(entry.providerId());
@@ -455,20 +908,26 @@ void Engine::loadDetails(const KNS3::EntryInternal &entry)
 
 void Engine::loadPreview(const KNS3::EntryInternal &entry, EntryInternal::PreviewType type)
 {
-    qCDebug(KNEWSTUFF) << "START  preview: " << entry.name() << type;
-    ImageLoader *l = new ImageLoader(entry, type, this);
-    connect(l, &ImageLoader::signalPreviewLoaded, this, &Engine::slotPreviewLoaded);
-    l->start();
-    ++m_numPictureJobs;
-    updateStatus();
+    const QString host = QUrl(entry.previewUrl(type)).host();
+    m_scheduler->schedule(JobScheduler::Preview, host, 0, [this, entry, type](int ticket) {
+        qCDebug(KNEWSTUFF) << "START  preview: " << entry.name() << type;
+        ImageLoader *l = new ImageLoader(entry, type, this);
+        connect(l, &ImageLoader::signalPreviewLoaded, this, &Engine::slotPreviewLoaded);
+        connect(l, &ImageLoader::signalError, this, &Engine::signalPreviewFailed);
+        connect(l, &QObject::destroyed, m_scheduler, [this, l, ticket]() {
+            m_imageLoaders.remove(l);
+            m_scheduler->finished(ticket);
+        });
+        m_imageLoaders.insert(l);
+        l->start();
+    });
 }
 
 void Engine::slotPreviewLoaded(const KNS3::EntryInternal &entry, EntryInternal::PreviewType type)
 {
     qCDebug(KNEWSTUFF) << "FINISH preview: " << entry.name() << type;
+    m_cache->addPreviewImage(entry, type);
     emit signalEntryPreviewLoaded(entry, type);
-    --m_numPictureJobs;
-    updateStatus();
 }
 
 void Engine::contactAuthor(const EntryInternal &entry)
@@ -518,11 +977,12 @@ void Engine::becomeFan(const EntryInternal &entry)
 
 void Engine::updateStatus()
 {
-    if (m_numDataJobs > 0) {
+    const int previews = m_scheduler->pendingJobs(JobScheduler::Preview);
+    if (m_scheduler->pendingJobs(JobScheduler::Metadata) > 0) {
         emit signalBusy(i18n("Loading data"));
-    } else if (m_numPictureJobs > 0) {
-        emit signalBusy(i18np("Loading one preview", "Loading %1 previews", m_numPictureJobs));
-    } else if (m_numInstallJobs > 0) {
+    } else if (previews > 0) {
+        emit signalBusy(i18np("Loading one preview", "Loading %1 previews", previews));
+    } else if (m_scheduler->pendingJobs(JobScheduler::Payload) > 0) {
         emit signalBusy(i18n("Installing"));
     } else {
         emit signalIdle(QString());
@@ -531,17 +991,38 @@ void Engine::updateStatus()
 
 void Engine::checkForUpdates()
 {
+    if (m_providers.isEmpty()) {
+        emit signalUpdateCheckFinished();
+        return;
+    }
     foreach (QSharedPointer<Provider> p, m_providers) {
-        Provider::SearchRequest request(KNS3::Provider::Updates);
-        p->loadEntries(request);
+        ++m_pendingUpdateChecks;
+        m_scheduler->schedule(JobScheduler::UpdateCheck, QString(), 0, [this, p](int ticket) {
+            if (m_updateCheckTickets.contains(p->id())) {
+                // the check that is already running will answer
+                m_scheduler->finished(ticket);
+                updateCheckFinished();
+                return;
+            }
+            m_updateCheckTickets.insert(p->id(), ticket);
+            Provider::SearchRequest request(KNS3::Provider::Updates);
+            p->loadEntries(request);
+        });
     }
 }
 
-void KNS3::Engine::checkForInstalled()
+void Engine::updateCheckFinished()
 {
-    foreach (QSharedPointer<Provider> p, m_providers) {
-        Provider::SearchRequest request(KNS3::Provider::Installed);
-        request.page = 0;
-        p->loadEntries(request);
+    if (--m_pendingUpdateChecks == 0) {
+        emit signalUpdateCheckFinished();
     }
 }
+
+void KNS3::Engine::checkForInstalled()
+{
+    Provider::SearchRequest request(KNS3::Provider::Installed);
+    request.page = 0;
+
+    m_merger.reset();
+    sendRequest(request);
+}
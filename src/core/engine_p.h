@@ -21,13 +21,17 @@
 #ifndef KNEWSTUFF3_ENGINE_P_H
 #define KNEWSTUFF3_ENGINE_P_H
 
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QObject>
 #include <QtCore/QString>
 #include <QtCore/QMap>
+#include <QtCore/QSet>
 #include <QtCore/QSharedPointer>
 
 #include "provider_p.h"
 #include "entryinternal_p.h"
+#include "resultmerger_p.h"
+#include "jobscheduler_p.h"
 
 class QTimer;
 class KJob;
@@ -41,6 +45,7 @@ class Provider;
 namespace KNS3
 {
 class Cache;
+class ImageLoader;
 class Installation;
 
 /**
@@ -98,6 +103,12 @@ public:
      */
     void uninstall(KNS3::EntryInternal entry);
 
+    /**
+     * Whether installations and providers may ask the user questions, see Installation::setInteractive()
+     * and Provider::setInteractive()
+     */
+    void setInteractive(bool interactive);
+
     void loadPreview(const KNS3::EntryInternal &entry, EntryInternal::PreviewType type);
     void loadDetails(const KNS3::EntryInternal &entry);
 
@@ -135,9 +146,17 @@ Q_SIGNALS:
     void signalMessage(const QString &message);
 
     void signalProvidersLoaded();
+    // entries to add to the view: local results and feeds that are still loading are shown
+    // ahead of their page, the complete page then only adds what is not shown yet
     void signalEntriesLoaded(const KNS3::EntryInternal::List &entries);
+    // a complete page of the current request, once per page, with all of its entries
+    void signalPageLoaded(const KNS3::EntryInternal::List &entries);
     void signalUpdateableEntriesLoaded(const KNS3::EntryInternal::List &entries);
+    // all providers answered checkForUpdates(), after their signalUpdateableEntriesLoaded()
+    void signalUpdateCheckFinished();
     void signalEntryChanged(const KNS3::EntryInternal &entry);
+    // an entry that was shown is not part of the results anymore
+    void signalEntryRemoved(const KNS3::EntryInternal &entry);
     void signalEntryDetailsLoaded(const KNS3::EntryInternal &entry);
 
     // a new search result is there, clear the list of items
@@ -169,15 +188,18 @@ private Q_SLOTS:
     void providerInitialized(KNS3::Provider *);
 
     void slotEntriesLoaded(const KNS3::Provider::SearchRequest &, KNS3::EntryInternal::List);
+    void slotEntriesProgress(const KNS3::Provider::SearchRequest &, const KNS3::EntryInternal::List &);
+    void slotEntriesFailed(const KNS3::Provider::SearchRequest &);
     void slotEntryDetailsLoaded(const KNS3::EntryInternal &entry);
     void slotPreviewLoaded(const KNS3::EntryInternal &entry, KNS3::EntryInternal::PreviewType type);
 
     void slotSearchTimerExpired();
 
     void slotEntryChanged(const KNS3::EntryInternal &entry);
-    void slotInstallationFinished();
-    void slotInstallationFailed(const QString &message);
+    void slotInstallationFinished(const KNS3::EntryInternal &entry);
+    void slotInstallationFailed(const QString &message, const KNS3::EntryInternal &entry);
     void downloadLinkLoaded(const KNS3::EntryInternal &entry);
+    void downloadLinkFailed(const KNS3::EntryInternal &entry);
 
     void providerJobStarted(KJob *);
 
@@ -197,6 +219,35 @@ private:
 
     void doRequest();
 
+    // send the request to all providers, unless an identical request is already on its way
+    void sendRequest(const Provider::SearchRequest &request);
+    // stop loading what the view does not show anymore
+    void abortStaleWork();
+    // a provider answered a request
+    void requestFinished(const Provider::SearchRequest &request, const QString &providerId);
+
+    // show the entries that are known locally and match the current search right away
+    void showLocalResults();
+    // show the result of a search that was answered from a complete result set in the cache
+    void showRefinedResults(const EntryInternal::List &entries);
+    // how long to wait for more keystrokes before asking the providers
+    int searchDelay() const;
+    // ask the providers again for the pages of an earlier session that are shown
+    void revalidateResults();
+    void finishRevalidation();
+
+    // hand a complete page to the view
+    void showPage(const Provider::SearchRequest &request, const EntryInternal::List &entries);
+    // speculatively request the pages following the one that was just shown
+    void prefetchAfter(const Provider::SearchRequest &request, const EntryInternal::List &entries);
+
+    // collect the answer of one provider and emit the page once all providers answered
+    void addProviderResults(const Provider::SearchRequest &request, const QString &providerId, const EntryInternal::List &entries);
+    // all providers answered or failed, cache and show the merged page
+    void pageCompleted(const Provider::SearchRequest &request);
+    // the update check of one provider is over, signal once all of them are
+    void updateCheckFinished();
+
     // handle installation of entries
     Installation *m_installation;
     // read/write cache of entries
@@ -214,6 +265,32 @@ private:
 
     // the current request from providers
     Provider::SearchRequest m_currentRequest;
+    // merges the per provider answers into ordered pages without duplicates
+    ResultMerger m_merger;
+    // the providers that have been asked for a request and did not answer yet
+    // (providerId -> scheduler ticket)
+    QHash<Provider::SearchRequest, QHash<QString, int> > m_requestsInFlight;
+    // when the requests in flight were sent, in ms of m_clock
+    QHash<Provider::SearchRequest, qint64> m_requestStarted;
+    // entries shown by the local search, the provider results only add to them
+    QSet<EntryInternal> m_localResults;
+    // entries of an earlier session shown for m_staleRequest, refreshed once the providers are loaded
+    QSet<EntryInternal> m_staleResults;
+    Provider::SearchRequest m_staleRequest;
+    // pages asked for again to refresh stale results
+    QSet<Provider::SearchRequest> m_revalidatedPages;
+    // the stale entries being refreshed, and the entries the providers returned for them
+    QSet<EntryInternal> m_revalidatedEntries;
+    QSet<EntryInternal> m_freshResults;
+    bool m_revalidationFailed;
+
+    QElapsedTimer m_clock;
+    // when the search term was changed last, in ms of m_clock
+    qint64 m_lastKeystroke;
+    // average time between two keystrokes while typing a search term, in ms
+    int m_typingInterval;
+    // average time the providers need to answer a request, in ms
+    int m_providerLatency;
     Attica::ProviderManager *m_atticaProviderManager;
 
     // the page that is currently displayed, so it is not requested repeatedly
@@ -222,9 +299,33 @@ private:
     // when requesting entries from a provider, how many to ask for
     int m_pageSize;
 
-    int m_numDataJobs;
-    int m_numPictureJobs;
-    int m_numInstallJobs;
+    // how many pages to load ahead of the one that is shown (PrefetchPages in the knsrc file)
+    int m_prefetchPages;
+    // how many speculative pages may be in flight or waiting in the cache at the same time
+    int m_prefetchMaxRequests;
+    // how many bytes of speculatively loaded pages may wait in the cache
+    qint64 m_prefetchMaxBytes;
+    // speculative requests that are on the wire
+    QSet<Provider::SearchRequest> m_prefetchRequests;
+    // speculatively loaded pages that have not been shown yet, and their approximate size
+    QHash<Provider::SearchRequest, qint64> m_prefetchedPages;
+    // speculatively loaded pages that are not in the cache because a provider failed, and empty ones
+    QHash<Provider::SearchRequest, EntryInternal::List> m_incompletePages;
+    // how long (s) downloaded provider files and feeds are used without asking the server (FeedMaxAge in the knsrc file)
+    int m_feedMaxAge;
+
+    // starts the network work of the engine, one job class at a time is limited
+    JobScheduler *m_scheduler;
+    // scheduler tickets of running update checks (providerId -> ticket)
+    QHash<QString, int> m_updateCheckTickets;
+    // update checks of single providers that are scheduled or running
+    int m_pendingUpdateChecks;
+    // scheduler tickets of running installations, by entry (providerId and uniqueId)
+    QHash<EntryInternal, int> m_installTickets;
+    // running preview downloads
+    QSet<ImageLoader *> m_imageLoaders;
+    // whether the user may be asked questions, see setInteractive()
+    bool m_interactive;
     // If the provider is ready to be used
     bool m_initialized;
 
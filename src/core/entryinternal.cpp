@@ -361,19 +361,25 @@ void EntryInternal::setKnowledgebaseLink(const QString &link)
     d->mKnowledgebaseLink = link;
 }
 
-/*
 QString EntryInternal::checksum() const
 {
-
     return d->mChecksum;
 }
 
-QString EntryInternal::signature() const
+void EntryInternal::setChecksum(const QString &checksum)
 {
+    d->mChecksum = checksum;
+}
 
+QString EntryInternal::signature() const
+{
     return d->mSignature;
 }
-*/
+
+void EntryInternal::setSignature(const QString &signature)
+{
+    d->mSignature = signature;
+}
 
 EntryInternal::Source EntryInternal::source() const
 {
@@ -595,6 +601,123 @@ QDomElement KNS3::EntryInternal::entryXML() const
     return el;
 }
 
+qint64 EntryInternal::approximateSize() const
+{
+    qint64 characters = d->mUniqueId.size() + d->mName.size() + d->mCategory.size()
+                        + d->mLicense.size() + d->mVersion.size() + d->mUpdateVersion.size()
+                        + d->mKnowledgebaseLink.size() + d->mSummary.size() + d->mShortSummary.size()
+                        + d->mChangelog.size() + d->mPayload.size() + d->mProviderId.size()
+                        + d->mDonationLink.size() + d->mChecksum.size() + d->mSignature.size()
+                        + d->mAuthor.name().size() + d->mAuthor.email().size()
+                        + d->mAuthor.jabber().size() + d->mAuthor.homepage().size();
+    foreach (const QString &file, d->mInstalledFiles) {
+        characters += file.size();
+    }
+    foreach (const QString &file, d->mUnInstalledFiles) {
+        characters += file.size();
+    }
+
+    qint64 size = sizeof(Private) + characters * qint64(sizeof(QChar));
+    for (int i = 0; i < 6; ++i) {
+        size += d->mPreviewUrl[i].size() * qint64(sizeof(QChar));
+        size += d->mPreviewImage[i].byteCount();
+    }
+    size += d->mDownloadLinkInformationList.size() * qint64(sizeof(DownloadLinkInformation));
+    return size;
+}
+
+QDataStream &KNS3::operator<<(QDataStream &stream, const EntryInternal &entry)
+{
+    stream << entry.providerId() << entry.uniqueId() << entry.name() << entry.category()
+           << entry.author().name() << entry.author().email() << entry.author().jabber() << entry.author().homepage()
+           << entry.homepage().url() << entry.license() << entry.version() << entry.releaseDate()
+           << entry.updateVersion() << entry.updateReleaseDate() << entry.summary() << entry.shortSummary()
+           << entry.changelog() << entry.payload() << entry.checksum() << entry.signature()
+           << entry.donationLink() << entry.knowledgebaseLink()
+           << qint32(entry.rating()) << qint32(entry.numberOfComments()) << qint32(entry.downloadCount())
+           << qint32(entry.numberFans()) << qint32(entry.numberKnowledgebaseEntries())
+           << quint8(entry.status()) << entry.installedFiles() << entry.uninstalledFiles();
+    for (int i = 0; i < 6; ++i) {
+        stream << entry.previewUrl(EntryInternal::PreviewType(i));
+    }
+    const QList<EntryInternal::DownloadLinkInformation> links = entry.downloadLinkInformationList();
+    stream << qint32(links.size());
+    foreach (const EntryInternal::DownloadLinkInformation &link, links) {
+        stream << link.name << link.priceAmount << link.distributionType << link.descriptionLink
+               << qint32(link.id) << link.isDownloadtypeLink << link.size;
+    }
+    return stream;
+}
+
+QDataStream &KNS3::operator>>(QDataStream &stream, EntryInternal &entry)
+{
+    QString providerId, uniqueId, name, category, authorName, authorEmail, authorJabber, authorHomepage;
+    QString homepage, license, version, updateVersion, summary, shortSummary, changelog, payload;
+    QString checksum, signature, donationLink, knowledgebaseLink;
+    QDate releaseDate, updateReleaseDate;
+    qint32 rating, comments, downloads, fans, knowledgebaseEntries;
+    quint8 status;
+    QStringList installedFiles, uninstalledFiles;
+    stream >> providerId >> uniqueId >> name >> category
+           >> authorName >> authorEmail >> authorJabber >> authorHomepage
+           >> homepage >> license >> version >> releaseDate
+           >> updateVersion >> updateReleaseDate >> summary >> shortSummary
+           >> changelog >> payload >> checksum >> signature
+           >> donationLink >> knowledgebaseLink
+           >> rating >> comments >> downloads >> fans >> knowledgebaseEntries
+           >> status >> installedFiles >> uninstalledFiles;
+
+    entry.setProviderId(providerId);
+    entry.setUniqueId(uniqueId);
+    entry.setName(name);
+    entry.setCategory(category);
+    Author author;
+    author.setName(authorName);
+    author.setEmail(authorEmail);
+    author.setJabber(authorJabber);
+    author.setHomepage(authorHomepage);
+    entry.setAuthor(author);
+    entry.setHomepage(QUrl(homepage));
+    entry.setLicense(license);
+    entry.setVersion(version);
+    entry.setReleaseDate(releaseDate);
+    entry.setUpdateVersion(updateVersion);
+    entry.setUpdateReleaseDate(updateReleaseDate);
+    entry.setSummary(summary);
+    entry.setShortSummary(shortSummary);
+    entry.setChangelog(changelog);
+    entry.setPayload(payload);
+    entry.setChecksum(checksum);
+    entry.setSignature(signature);
+    entry.setDonationLink(donationLink);
+    entry.setKnowledgebaseLink(knowledgebaseLink);
+    entry.setRating(rating);
+    entry.setNumberOfComments(comments);
+    entry.setDownloadCount(downloads);
+    entry.setNumberFans(fans);
+    entry.setNumberKnowledgebaseEntries(knowledgebaseEntries);
+    entry.setStatus(Entry::Status(status));
+    entry.setInstalledFiles(installedFiles);
+    entry.setUnInstalledFiles(uninstalledFiles);
+    for (int i = 0; i < 6; ++i) {
+        QString url;
+        stream >> url;
+        entry.setPreviewUrl(url, EntryInternal::PreviewType(i));
+    }
+    qint32 linkCount;
+    stream >> linkCount;
+    entry.clearDownloadLinkInformation();
+    for (int i = 0; i < linkCount && stream.status() == QDataStream::Ok; ++i) {
+        EntryInternal::DownloadLinkInformation link;
+        qint32 id;
+        stream >> link.name >> link.priceAmount >> link.distributionType >> link.descriptionLink
+               >> id >> link.isDownloadtypeLink >> link.size;
+        link.id = id;
+        entry.appendDownloadLinkInformation(link);
+    }
+    return stream;
+}
+
 Entry EntryInternal::toEntry() const
 {
     Entry e;
@@ -22,6 +22,7 @@
 #ifndef KNEWSTUFF3_ENTRYINTERNAL_P_H
 #define KNEWSTUFF3_ENTRYINTERNAL_P_H
 
+#include <QtCore/QDataStream>
 #include <QtCore/QDate>
 #include <QtXml/QDomElement>
 #include <QtCore/QString>
@@ -385,7 +386,7 @@ public:
      *
      * @return Checksum of this entry
      */
-    //QString checksum() const;
+    QString checksum() const;
 
     /**
      * Sets the checksum of the entry. This will be a string representation
@@ -393,7 +394,7 @@ public:
      *
      * @ref checksum Checksum for the entry
      */
-    //void setChecksum(const QString& checksum);
+    void setChecksum(const QString &checksum);
 
     /**
      * Returns the signature for the entry.
@@ -402,7 +403,7 @@ public:
      *
      * @return Signature of this entry
      */
-    //QString signature() const;
+    QString signature() const;
 
     /**
      * Sets the signature of the entry. This will be a digital signature
@@ -410,7 +411,7 @@ public:
      *
      * @ref signature Signature for the entry
      */
-    //void setSignature(const QString& signature);
+    void setSignature(const QString &signature);
 
     /**
      * Sets the entry's status. If no status is set, the default will be
@@ -430,6 +431,12 @@ public:
     //void setIdNumber(int number);
     //int idNumber() const;
 
+    /**
+     * A rough estimate of the memory used by this entry in bytes,
+     * including the preview images that have been loaded.
+     */
+    qint64 approximateSize() const;
+
     Entry toEntry() const;
 
     static KNS3::EntryInternal fromEntry(const KNS3::Entry &entry);
@@ -440,9 +447,18 @@ private:
 
 inline uint qHash(const KNS3::EntryInternal &entry)
 {
-    return qHash(entry.uniqueId());
+    // the same id can be used by different providers
+    return qHash(entry.uniqueId()) ^ qHash(entry.providerId());
 }
 
+/**
+ * Serialize the meta data of an entry, without preview images.
+ * Used for the registry journal, the results kept across sessions and binary feeds,
+ * their format versions have to change with the layout.
+ */
+QDataStream &operator<<(QDataStream &stream, const KNS3::EntryInternal &entry);
+QDataStream &operator>>(QDataStream &stream, KNS3::EntryInternal &entry);
+
 }
 
 #endif
@@ -0,0 +1,100 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "entrystore_p.h"
+
+using namespace KNS3;
+
+EntryStore::EntryStore()
+{
+}
+
+void EntryStore::insert(const EntryInternal::List &entries)
+{
+    foreach (const EntryInternal &entry, entries) {
+        QHash<QString, int>::const_iterator it = m_positions.constFind(entry.uniqueId());
+        if (it != m_positions.constEnd()) {
+            m_entries[it.value()] = entry;
+        } else {
+            m_positions.insert(entry.uniqueId(), m_entries.size());
+            m_entries.append(entry);
+        }
+    }
+}
+
+EntryInternal EntryStore::merge(const EntryInternal &fresh)
+{
+    EntryInternal entry = fresh;
+
+    QHash<QString, int>::const_iterator it = m_positions.constFind(fresh.uniqueId());
+    if (it == m_positions.constEnd()) {
+        m_positions.insert(entry.uniqueId(), m_entries.size());
+        m_entries.append(entry);
+        return entry;
+    }
+
+    const EntryInternal stored = m_entries.at(it.value());
+    const bool installed = stored.status() == Entry::Installed || stored.status() == Entry::Updateable;
+    if (installed && isUpdate(stored, fresh)) {
+        // the stored version is the one on disk
+        entry.setStatus(Entry::Updateable);
+        entry.setUpdateVersion(fresh.version());
+        entry.setVersion(stored.version());
+        entry.setUpdateReleaseDate(fresh.releaseDate());
+        entry.setReleaseDate(stored.releaseDate());
+    } else {
+        entry.setStatus(stored.status());
+    }
+    if (installed) {
+        entry.setInstalledFiles(stored.installedFiles());
+    }
+
+    m_entries[it.value()] = entry;
+    return entry;
+}
+
+bool EntryStore::isUpdate(const EntryInternal &installed, const EntryInternal &offered)
+{
+    if (installed.version() != offered.version()) {
+        return true;
+    }
+    if (installed.releaseDate().isValid() && offered.releaseDate().isValid()
+            && installed.releaseDate() != offered.releaseDate()) {
+        return true;
+    }
+    return !installed.checksum().isEmpty() && !offered.checksum().isEmpty()
+           && installed.checksum() != offered.checksum();
+}
+
+EntryInternal EntryStore::entry(const QString &uniqueId) const
+{
+    QHash<QString, int>::const_iterator it = m_positions.constFind(uniqueId);
+    if (it == m_positions.constEnd()) {
+        return EntryInternal();
+    }
+    return m_entries.at(it.value());
+}
+
+EntryInternal::List EntryStore::entries() const
+{
+    return m_entries.toList();
+}
+
+int EntryStore::size() const
+{
+    return m_entries.size();
+}
@@ -0,0 +1,75 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef KNEWSTUFF3_ENTRYSTORE_P_H
+#define KNEWSTUFF3_ENTRYSTORE_P_H
+
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+
+#include "entryinternal_p.h"
+
+namespace KNS3
+{
+
+/**
+ * @short The entries a provider knows, looked up by their unique id.
+ *
+ * Holds the installed entries from the registry and everything the provider
+ * loaded since, in the order they were first seen.
+ *
+ * @internal
+ */
+class EntryStore
+{
+public:
+    EntryStore();
+
+    /// Add @p entries as they are, replacing stored entries with the same id
+    void insert(const EntryInternal::List &entries);
+
+    /**
+     * Merge @p fresh, the current data of an entry from the provider, with the stored entry
+     * of the same id and store the result.
+     *
+     * The result is @p fresh with the install state of the stored entry: its status and
+     * installed files. If an installed entry is offered as a different release (see isUpdate()),
+     * the result is Updateable and keeps the installed version and release date, the offered
+     * ones become the update version and update release date.
+     */
+    EntryInternal merge(const EntryInternal &fresh);
+
+    /**
+     * Whether @p offered is a different release than @p installed: it has a different version,
+     * release date or checksum. Release dates and checksums are only compared if both entries have one.
+     */
+    static bool isUpdate(const EntryInternal &installed, const EntryInternal &offered);
+
+    /// The stored entry with @p uniqueId, invalid if there is none
+    EntryInternal entry(const QString &uniqueId) const;
+    EntryInternal::List entries() const;
+    int size() const;
+
+private:
+    QVector<EntryInternal> m_entries;
+    // unique id -> position in m_entries
+    QHash<QString, int> m_positions;
+};
+
+}
+
+#endif
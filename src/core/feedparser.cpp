@@ -0,0 +1,439 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "feedparser_p.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QtEndian>
+#include <QtXml/qdom.h>
+#include <knewstuff_debug.h>
+
+using namespace KNS3;
+
+// the first chunk is small so the first entries show up quickly, later ones grow up to the maximum
+static const int FirstChunkSize = 32 * 1024;
+static const int MaxChunkSize = 1024 * 1024;
+
+static const char BinaryMagic[4] = { 'K', 'N', 'S', 'F' };
+// has to change with the stream operators of EntryInternal
+static const quint32 BinaryVersion = 1;
+// larger records are taken for damaged data
+static const quint32 MaxRecordSize = 16 * 1024 * 1024;
+
+Q_GLOBAL_STATIC(QThreadPool, parserPool)
+
+namespace
+{
+class ParseTask : public QRunnable
+{
+public:
+    ParseTask(const QSharedPointer<FeedParser::Results> &results, int sequence, const QByteArray &document, bool binary)
+        : m_results(results)
+        , m_sequence(sequence)
+        , m_document(document)
+        , m_binary(binary)
+    {
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        FeedParser::ParsedChunk chunk;
+        if (m_binary) {
+            chunk.valid = readRecords(chunk.entries);
+        } else {
+            QDomDocument doc;
+            QString errorMessage;
+            chunk.valid = doc.setContent(m_document, &errorMessage);
+            if (chunk.valid) {
+                for (QDomElement e = doc.documentElement().firstChildElement(); !e.isNull(); e = e.nextSiblingElement()) {
+                    EntryInternal entry;
+                    entry.setEntryXML(e);
+                    chunk.entries.append(entry);
+                }
+            } else {
+                qCDebug(KNEWSTUFF) << "Cannot parse feed chunk" << m_sequence << errorMessage;
+            }
+        }
+
+        QMutexLocker locker(&m_results->mutex);
+        if (m_results->receiver) {
+            m_results->chunks.insert(m_sequence, chunk);
+            QMetaObject::invokeMethod(m_results->receiver, "deliverChunks", Qt::QueuedConnection);
+        }
+    }
+
+private:
+    // the chunk holds complete records of a binary feed
+    bool readRecords(EntryInternal::List &entries) const
+    {
+        const uchar *data = reinterpret_cast<const uchar *>(m_document.constData());
+        int pos = 0;
+        while (pos < m_document.size()) {
+            const int length = qFromBigEndian<quint32>(data + pos);
+            QDataStream stream(QByteArray::fromRawData(m_document.constData() + pos + 4, length));
+            stream.setVersion(QDataStream::Qt_5_5);
+            EntryInternal entry;
+            stream >> entry;
+            if (stream.status() != QDataStream::Ok) {
+                qCDebug(KNEWSTUFF) << "Cannot read record of binary feed chunk" << m_sequence;
+                return false;
+            }
+            entries.append(entry);
+            pos += 4 + length;
+        }
+        return true;
+    }
+
+    QSharedPointer<FeedParser::Results> m_results;
+    int m_sequence;
+    QByteArray m_document;
+    bool m_binary;
+};
+}
+
+FeedParser::FeedParser(QObject *parent)
+    : QObject(parent)
+    , m_results(new Results)
+    , m_scanned(0)
+    , m_completeEnd(0)
+    , m_depth(0)
+    , m_rootClosed(false)
+    , m_chunkSize(FirstChunkSize)
+    , m_dispatched(0)
+    , m_delivered(0)
+    , m_inputFinished(false)
+    , m_stopped(false)
+    , m_format(UnknownFormat)
+{
+    m_results->receiver = this;
+}
+
+FeedParser::~FeedParser()
+{
+    abort();
+}
+
+void FeedParser::addData(const QByteArray &data)
+{
+    if (m_stopped || m_inputFinished) {
+        return;
+    }
+    m_buffer.append(data);
+    if (!detectFormat()) {
+        return;
+    }
+    if (!(m_format == BinaryFormat ? scanBinary() : scan())) {
+        fail();
+        return;
+    }
+    if (m_completeEnd >= m_chunkSize) {
+        dispatch(m_completeEnd);
+        m_chunkSize = qMin(m_chunkSize * 2, MaxChunkSize);
+    }
+}
+
+void FeedParser::finish()
+{
+    if (m_stopped || m_inputFinished) {
+        return;
+    }
+    m_inputFinished = true;
+    detectFormat();
+    if (!(m_format == BinaryFormat ? scanBinary() : scan()) || !m_rootClosed) {
+        qCDebug(KNEWSTUFF) << "Feed ended before its document element was closed";
+        fail();
+        return;
+    }
+    if (m_completeEnd > 0) {
+        dispatch(m_completeEnd);
+    }
+    m_buffer.clear();
+    // deliver from the event loop, like the chunks that are parsed on other threads
+    QMetaObject::invokeMethod(this, "deliverChunks", Qt::QueuedConnection);
+}
+
+void FeedParser::abort()
+{
+    m_stopped = true;
+    m_buffer.clear();
+    QMutexLocker locker(&m_results->mutex);
+    m_results->receiver = 0;
+    m_results->chunks.clear();
+}
+
+QDomDocument FeedParser::documentSkeleton() const
+{
+    QDomDocument doc;
+    if (m_format == BinaryFormat) {
+        QDomElement root = doc.createElement(QStringLiteral("knewstuff"));
+        if (!m_generation.isEmpty()) {
+            root.setAttribute(QStringLiteral("generation"), m_generation);
+        }
+        doc.appendChild(root);
+        return doc;
+    }
+
+    QByteArray document = m_prologue;
+    if (!document.endsWith("/>")) {
+        document.append("</").append(m_rootName).append('>');
+    }
+    doc.setContent(document);
+    return doc;
+}
+
+QByteArray FeedParser::binaryHeader(const QString &generation)
+{
+    const QByteArray utf8 = generation.toUtf8();
+    QByteArray header(BinaryMagic, sizeof(BinaryMagic));
+    header.resize(12);
+    qToBigEndian<quint32>(BinaryVersion, reinterpret_cast<uchar *>(header.data() + 4));
+    qToBigEndian<quint32>(utf8.size(), reinterpret_cast<uchar *>(header.data() + 8));
+    return header + utf8;
+}
+
+QByteArray FeedParser::binaryRecord(const EntryInternal &entry)
+{
+    QByteArray record(4, 0);
+    {
+        QDataStream stream(&record, QIODevice::WriteOnly | QIODevice::Append);
+        stream.setVersion(QDataStream::Qt_5_5);
+        stream << entry;
+    }
+    qToBigEndian<quint32>(record.size() - 4, reinterpret_cast<uchar *>(record.data()));
+    return record;
+}
+
+QByteArray FeedParser::binaryEnd()
+{
+    return QByteArray(4, 0);
+}
+
+bool FeedParser::detectFormat()
+{
+    if (m_format != UnknownFormat) {
+        return true;
+    }
+    if (m_buffer.size() < int(sizeof(BinaryMagic)) && !m_inputFinished) {
+        return false;
+    }
+    m_format = m_buffer.startsWith(QByteArray(BinaryMagic, sizeof(BinaryMagic))) ? BinaryFormat : XmlFormat;
+    return true;
+}
+
+void FeedParser::fail()
+{
+    abort();
+    emit parsingFailed();
+}
+
+void FeedParser::dispatch(int size)
+{
+    QByteArray document;
+    if (m_format == BinaryFormat) {
+        document = m_buffer.left(size);
+    } else {
+        document = m_prologue;
+        document.append(m_buffer.constData(), size);
+        document.append("</").append(m_rootName).append('>');
+    }
+
+    m_buffer.remove(0, size);
+    m_scanned -= size;
+    m_completeEnd = 0;
+    parserPool()->start(new ParseTask(m_results, m_dispatched++, document, m_format == BinaryFormat));
+}
+
+void FeedParser::deliverChunks()
+{
+    if (m_stopped) {
+        return;
+    }
+
+    QList<ParsedChunk> ready;
+    {
+        QMutexLocker locker(&m_results->mutex);
+        while (m_results->chunks.contains(m_delivered)) {
+            ready.append(m_results->chunks.take(m_delivered));
+            ++m_delivered;
+        }
+    }
+
+    foreach (const ParsedChunk &chunk, ready) {
+        if (!chunk.valid) {
+            fail();
+            return;
+        }
+        if (!chunk.entries.isEmpty()) {
+            emit entriesParsed(chunk.entries);
+        }
+        if (m_stopped) {
+            // aborted by a receiver
+            return;
+        }
+    }
+
+    if (m_inputFinished && m_delivered == m_dispatched) {
+        m_stopped = true;
+        emit parsingFinished();
+    }
+}
+
+bool FeedParser::scanBinary()
+{
+    if (m_rootName.isEmpty()) {
+        // magic, version and length of the generation
+        if (m_buffer.size() < 12) {
+            return true;
+        }
+        const uchar *data = reinterpret_cast<const uchar *>(m_buffer.constData());
+        if (qFromBigEndian<quint32>(data + 4) != BinaryVersion) {
+            qCDebug(KNEWSTUFF) << "Unknown binary feed version" << qFromBigEndian<quint32>(data + 4);
+            return false;
+        }
+        const quint32 length = qFromBigEndian<quint32>(data + 8);
+        if (length > MaxRecordSize) {
+            return false;
+        }
+        if (quint32(m_buffer.size()) < 12 + length) {
+            return true;
+        }
+        m_generation = QString::fromUtf8(m_buffer.constData() + 12, length);
+        m_rootName = "knewstuff";
+        m_buffer.remove(0, 12 + length);
+        m_scanned = 0;
+    }
+
+    const uchar *data = reinterpret_cast<const uchar *>(m_buffer.constData());
+    int pos = m_scanned;
+    while (!m_rootClosed && m_buffer.size() - pos >= 4) {
+        const quint32 length = qFromBigEndian<quint32>(data + pos);
+        if (length == 0) {
+            // the end, anything after it is ignored
+            m_rootClosed = true;
+            break;
+        }
+        if (length > MaxRecordSize) {
+            return false;
+        }
+        if (quint32(m_buffer.size() - pos - 4) < length) {
+            break;
+        }
+        pos += 4 + length;
+        m_completeEnd = pos;
+    }
+    m_scanned = pos;
+    return true;
+}
+
+bool FeedParser::scan()
+{
+    int pos = m_scanned;
+    while (!m_rootClosed) {
+        const int open = m_buffer.indexOf('<', pos);
+        if (open < 0) {
+            pos = m_buffer.size();
+            break;
+        }
+        const char *data = m_buffer.constData();
+        const int size = m_buffer.size();
+        if (!m_inputFinished && size - open < 9) {
+            // not enough to tell what kind of markup this is
+            pos = open;
+            break;
+        }
+
+        int end = -1;
+        if (qstrncmp(data + open, "<!--", 4) == 0) {
+            const int close = m_buffer.indexOf("-->", open + 4);
+            end = close < 0 ? -1 : close + 3;
+        } else if (qstrncmp(data + open, "<![CDATA[", 9) == 0) {
+            const int close = m_buffer.indexOf("]]>", open + 9);
+            end = close < 0 ? -1 : close + 3;
+        } else if (data[open + 1] == '?') {
+            const int close = m_buffer.indexOf("?>", open + 2);
+            end = close < 0 ? -1 : close + 2;
+        } else {
+            // a tag or a doctype declaration, '>' within quotes or an internal subset does not end it
+            char quote = 0;
+            int brackets = 0;
+            for (int i = open + 1; i < size; ++i) {
+                const char c = data[i];
+                if (quote) {
+                    if (c == quote) {
+                        quote = 0;
+                    }
+                } else if (c == '"' || c == '\'') {
+                    quote = c;
+                } else if (c == '[' && data[open + 1] == '!') {
+                    ++brackets;
+                } else if (c == ']' && brackets > 0) {
+                    --brackets;
+                } else if (c == '>' && brackets == 0) {
+                    end = i + 1;
+                    break;
+                }
+            }
+            if (end >= 0 && data[open + 1] != '!') {
+                const bool closing = data[open + 1] == '/';
+                const bool empty = data[end - 2] == '/';
+                if (closing) {
+                    --m_depth;
+                    if (m_depth == 1) {
+                        m_completeEnd = end;
+                    } else if (m_depth == 0) {
+                        m_rootClosed = true;
+                    } else if (m_depth < 0) {
+                        return false;
+                    }
+                } else if (m_depth == 0) {
+                    // the document element, chunks are wrapped in a copy of its start tag
+                    if (!m_rootName.isEmpty()) {
+                        return false;
+                    }
+                    int nameEnd = open + 1;
+                    while (nameEnd < end && !strchr(" \t\r\n/>", data[nameEnd])) {
+                        ++nameEnd;
+                    }
+                    m_rootName = QByteArray(data + open + 1, nameEnd - open - 1);
+                    m_prologue = m_buffer.left(end);
+                    if (empty) {
+                        m_rootClosed = true;
+                    } else {
+                        m_depth = 1;
+                    }
+                    m_buffer.remove(0, end);
+                    pos = 0;
+                    continue;
+                } else if (!empty) {
+                    ++m_depth;
+                } else if (m_depth == 1) {
+                    m_completeEnd = end;
+                }
+            }
+        }
+        if (end < 0) {
+            // the rest of the markup has not arrived yet
+            pos = open;
+            break;
+        }
+        pos = end;
+    }
+    m_scanned = pos;
+    return true;
+}
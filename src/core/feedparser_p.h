@@ -0,0 +1,132 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef KNEWSTUFF3_FEEDPARSER_P_H
+#define KNEWSTUFF3_FEEDPARSER_P_H
+
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QSharedPointer>
+#include <QtXml/qdom.h>
+
+#include "entryinternal_p.h"
+
+namespace KNS3
+{
+
+/**
+ * @short Turns a feed into entries on worker threads.
+ *
+ * The data of the document is split into chunks of complete children of the
+ * document element as it arrives. The chunks are parsed in parallel on a
+ * shared thread pool and their entries are delivered in document order on the
+ * thread of the parser.
+ *
+ * Besides XML, feeds can be in a binary format that is decoded without
+ * building a document tree. It is recognized by its magic bytes:
+ * "KNSF", the format version and the generation of the feed (a length and
+ * UTF-8 data), then one record per entry (a length and the entry as written
+ * to a QDataStream) and a record of length 0 at the end. All numbers are 32 bit
+ * big endian.
+ *
+ * @internal
+ */
+class FeedParser : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FeedParser(QObject *parent = 0);
+    ~FeedParser();
+
+    /// More data of the document
+    void addData(const QByteArray &data);
+    /// All data has been added, parsingFinished() follows the last entries
+    void finish();
+    /// Stop parsing, no more signals are emitted
+    void abort();
+
+    /// The document element with its attributes but without children, once it has been read
+    QDomDocument documentSkeleton() const;
+
+    /// The start of a binary feed with @p generation, followed by binaryRecord()s and binaryEnd()
+    static QByteArray binaryHeader(const QString &generation);
+    static QByteArray binaryRecord(const EntryInternal &entry);
+    static QByteArray binaryEnd();
+
+Q_SIGNALS:
+    /// Entries of the next chunk of the document
+    void entriesParsed(const KNS3::EntryInternal::List &entries);
+    void parsingFinished();
+    void parsingFailed();
+
+private Q_SLOTS:
+    void deliverChunks();
+
+public:
+    // shared with the parse tasks, which may outlive the parser
+    struct ParsedChunk {
+        EntryInternal::List entries;
+        bool valid;
+    };
+    struct Results {
+        QMutex mutex;
+        FeedParser *receiver;
+        QMap<int, ParsedChunk> chunks;
+    };
+
+private:
+    // find the ends of complete children of the document element, false on malformed data
+    bool scan();
+    // find the ends of complete records of a binary feed, false on malformed data
+    bool scanBinary();
+    // look at the first bytes to tell the format, false if more are needed
+    bool detectFormat();
+    void dispatch(int size);
+    void fail();
+
+    QSharedPointer<Results> m_results;
+    // data that has not been dispatched yet, and how far it has been scanned
+    QByteArray m_buffer;
+    int m_scanned;
+    // end of the last complete child of the document element in the buffer
+    int m_completeEnd;
+    int m_depth;
+    // everything before the document element and its start tag, to wrap each chunk
+    QByteArray m_prologue;
+    QByteArray m_rootName;
+    bool m_rootClosed;
+    int m_chunkSize;
+    int m_dispatched;
+    int m_delivered;
+    bool m_inputFinished;
+    bool m_stopped;
+    enum Format {
+        UnknownFormat,
+        XmlFormat,
+        BinaryFormat
+    };
+    Format m_format;
+    // the generation given in the header of a binary feed
+    QString m_generation;
+
+    Q_DISABLE_COPY(FeedParser)
+};
+
+}
+
+#endif
@@ -43,9 +43,52 @@
 #include <windows.h>
 #include <shlobj.h>
 #endif
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <linux/fs.h>
+#endif
 
 using namespace KNS3;
 
+// Put a copy of @p source at @p target without reading it if possible: a copy on write clone (reflink),
+// else a hard link, which needs both on the same file system and a source the user cannot change, else a plain copy
+static bool linkOrCopyFile(const QString &source, const QString &target)
+{
+#ifdef Q_OS_UNIX
+    const QByteArray sourcePath = QFile::encodeName(source);
+    const QByteArray targetPath = QFile::encodeName(target);
+#ifdef FICLONE
+    const int sourceFd = ::open(sourcePath.constData(), O_RDONLY | O_CLOEXEC);
+    if (sourceFd >= 0) {
+        const int targetFd = ::open(targetPath.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        bool cloned = false;
+        if (targetFd >= 0) {
+            cloned = ::ioctl(targetFd, FICLONE, sourceFd) == 0;
+            ::close(targetFd);
+            if (!cloned) {
+                ::unlink(targetPath.constData());
+            }
+        }
+        ::close(sourceFd);
+        if (cloned) {
+            qCDebug(KNEWSTUFF) << "Cloned" << source << "to" << target;
+            return true;
+        }
+    }
+#endif
+    // a link shares the file, writing to the installed file would change the mirror and the other way round
+    if (::access(sourcePath.constData(), W_OK) != 0 && ::link(sourcePath.constData(), targetPath.constData()) == 0) {
+        qCDebug(KNEWSTUFF) << "Linked" << source << "to" << target;
+        return true;
+    }
+#endif
+    return QFile::copy(source, target);
+}
+
 Installation::Installation(QObject *parent)
     : QObject(parent)
     , checksumPolicy(Installation::CheckIfPossible)
@@ -53,9 +96,26 @@ Installation::Installation(QObject *parent)
     , scope(Installation::ScopeUser)
     , customName(false)
     , acceptHtml(false)
+    , interactive(true)
 {
 }
 
+void Installation::setInteractive(bool interactive)
+{
+    this->interactive = interactive;
+}
+
+void Installation::resetStatus(EntryInternal entry)
+{
+    // the installation failed, the entry is in the state it had before
+    if (entry.status() == Entry::Installing) {
+        entry.setStatus(Entry::Downloadable);
+    } else if (entry.status() == Entry::Updating) {
+        entry.setStatus(Entry::Updateable);
+    }
+    emit signalEntryChanged(entry);
+}
+
 bool Installation::readConfig(const KConfigGroup &group)
 {
     // FIXME: add support for several categories later on
@@ -172,14 +232,15 @@ void Installation::install(EntryInternal entry)
 void Installation::downloadPayload(const KNS3::EntryInternal &entry)
 {
     if (!entry.isValid()) {
-        emit signalInstallationFailed(i18n("Invalid item."));
+        emit signalInstallationFailed(i18n("Invalid item."), entry);
         return;
     }
     QUrl source = QUrl(entry.payload());
 
     if (!source.isValid()) {
         qCritical() << "The entry doesn't have a payload." << endl;
-        emit signalInstallationFailed(i18n("Download of item failed: no download URL for \"%1\".", entry.name()));
+        resetStatus(entry);
+        emit signalInstallationFailed(i18n("Download of item failed: no download URL for \"%1\".", entry.name()), entry);
         return;
     }
 
@@ -193,10 +254,28 @@ void Installation::downloadPayload(const KNS3::EntryInternal &entry)
         return;
     }
 
+    if (source.isLocalFile()) {
+        // a local or mounted mirror, the file is installed from where it is without a temporary copy
+        qCDebug(KNEWSTUFF) << "Installing local payload" << source;
+        if (!QFile::exists(source.toLocalFile())) {
+            resetStatus(entry);
+            emit signalInstallationFailed(i18n("Could not install \"%1\": file not found.", entry.name()), entry);
+            return;
+        }
+        if (!checkHtmlPayload(entry, source.toLocalFile(), source)) {
+            return;
+        }
+        install(entry, source.toLocalFile(), true);
+        emit signalPayloadLoaded(source);
+        return;
+    }
+
     QString fileName(source.fileName());
     QTemporaryFile tempFile(QDir::tempPath() + "/XXXXXX-" + fileName);
     if (!tempFile.open()) {
-        return;    // ERROR
+        resetStatus(entry);
+        emit signalInstallationFailed(i18n("Download of \"%1\" failed, error: %2", entry.name(), tempFile.errorString()), entry);
+        return;
     }
     QUrl destination = QUrl::fromLocalFile(tempFile.fileName());
     qCDebug(KNEWSTUFF) << "Downloading payload" << source << "to" << destination;
@@ -218,24 +297,12 @@ void Installation::slotPayloadResult(KJob *job)
         entry_jobs.remove(job);
 
         if (job->error()) {
-            emit signalInstallationFailed(i18n("Download of \"%1\" failed, error: %2", entry.name(), job->errorString()));
+            resetStatus(entry);
+            emit signalInstallationFailed(i18n("Download of \"%1\" failed, error: %2", entry.name(), job->errorString()), entry);
         } else {
             KIO::FileCopyJob *fcjob = static_cast<KIO::FileCopyJob *>(job);
-
-            // check if the app likes html files - disabled by default as too many bad links have been submitted to opendesktop.org
-            if (!acceptHtml) {
-                QMimeDatabase db;
-                QMimeType mimeType = db.mimeTypeForFile(fcjob->destUrl().toLocalFile());
-                if (mimeType.inherits(QStringLiteral("text/html")) || mimeType.inherits(QStringLiteral("application/x-php"))) {
-                    if (KMessageBox::questionYesNo(0, i18n("The downloaded file is a html file. This indicates a link to a website instead of the actual download. Would you like to open the site with a browser instead?"), i18n("Possibly bad download link"))
-                            == KMessageBox::Yes) {
-                        KRun::runUrl(fcjob->srcUrl(), QStringLiteral("text/html"), Q_NULLPTR);
-                        emit signalInstallationFailed(i18n("Downloaded file was a HTML file. Opened in browser."));
-                        entry.setStatus(Entry::Invalid);
-                        emit signalEntryChanged(entry);
-                        return;
-                    }
-                }
+            if (!checkHtmlPayload(entry, fcjob->destUrl().toLocalFile(), fcjob->srcUrl())) {
+                return;
             }
 
             install(entry, fcjob->destUrl().toLocalFile());
@@ -244,12 +311,42 @@ void Installation::slotPayloadResult(KJob *job)
     }
 }
 
-void Installation::install(KNS3::EntryInternal entry, const QString &downloadedFile)
+bool Installation::checkHtmlPayload(KNS3::EntryInternal entry, const QString &payloadfile, const QUrl &source)
+{
+    // check if the app likes html files - disabled by default as too many bad links have been submitted to opendesktop.org
+    if (acceptHtml) {
+        return true;
+    }
+    QMimeDatabase db;
+    QMimeType mimeType = db.mimeTypeForFile(payloadfile);
+    if (!mimeType.inherits(QStringLiteral("text/html")) && !mimeType.inherits(QStringLiteral("application/x-php"))) {
+        return true;
+    }
+    if (!interactive) {
+        emit signalInstallationFailed(i18n("Downloaded file was a HTML file."), entry);
+        entry.setStatus(Entry::Invalid);
+        emit signalEntryChanged(entry);
+        return false;
+    }
+    if (KMessageBox::questionYesNo(0, i18n("The downloaded file is a html file. This indicates a link to a website instead of the actual download. Would you like to open the site with a browser instead?"), i18n("Possibly bad download link"))
+            == KMessageBox::Yes) {
+        KRun::runUrl(source, QStringLiteral("text/html"), Q_NULLPTR);
+        emit signalInstallationFailed(i18n("Downloaded file was a HTML file. Opened in browser."), entry);
+        entry.setStatus(Entry::Invalid);
+        emit signalEntryChanged(entry);
+        return false;
+    }
+    return true;
+}
+
+void Installation::install(KNS3::EntryInternal entry, const QString &downloadedFile, bool keepPayload)
 {
     qCDebug(KNEWSTUFF) << "Install: " << entry.name() << " from " << downloadedFile;
 
     if (entry.payload().isEmpty()) {
         qCDebug(KNEWSTUFF) << "No payload associated with: " << entry.name();
+        resetStatus(entry);
+        emit signalInstallationFailed(i18n("Download of item failed: no download URL for \"%1\".", entry.name()), entry);
         return;
     }
 
@@ -284,16 +381,11 @@ void Installation::install(KNS3::EntryInternal entry, const QString &downloadedF
     */
 
     QString targetPath = targetInstallationPath(downloadedFile);
-    QStringList installedFiles = installDownloadedFileAndUncompress(entry, downloadedFile, targetPath);
+    QStringList installedFiles = installDownloadedFileAndUncompress(entry, downloadedFile, targetPath, keepPayload);
 
     if (installedFiles.isEmpty()) {
-        if (entry.status() == Entry::Installing) {
-            entry.setStatus(Entry::Downloadable);
-        } else if (entry.status() == Entry::Updating) {
-            entry.setStatus(Entry::Updateable);
-        }
-        emit signalEntryChanged(entry);
-        emit signalInstallationFailed(i18n("Could not install \"%1\": file not found.", entry.name()));
+        resetStatus(entry);
+        emit signalInstallationFailed(i18n("Could not install \"%1\": file not found.", entry.name()), entry);
         return;
     }
 
@@ -331,7 +423,7 @@ void Installation::install(KNS3::EntryInternal entry, const QString &downloadedF
 
     entry.setStatus(Entry::Installed);
     emit signalEntryChanged(entry);
-    emit signalInstallationFinished();
+    emit signalInstallationFinished(entry);
 }
 
 QString Installation::targetInstallationPath(const QString &payloadfile)
@@ -417,7 +509,7 @@ QString Installation::targetInstallationPath(const QString &payloadfile)
     return installdir;
 }
 
-QStringList Installation::installDownloadedFileAndUncompress(const KNS3::EntryInternal  &entry, const QString &payloadfile, const QString installdir)
+QStringList Installation::installDownloadedFileAndUncompress(const KNS3::EntryInternal  &entry, const QString &payloadfile, const QString installdir, bool keepPayload)
 {
     QString installpath(payloadfile);
     // Collect all files that were installed
@@ -480,7 +572,9 @@ QStringList Installation::installDownloadedFileAndUncompress(const KNS3::EntryIn
                     installedFiles << installpath + QLatin1Char('/');
 
                     archive->close();
-                    QFile::remove(payloadfile);
+                    if (!keepPayload) {
+                        QFile::remove(payloadfile);
+                    }
                 }
             }
         }
@@ -530,14 +624,16 @@ QStringList Installation::installDownloadedFileAndUncompress(const KNS3::EntryIn
             const bool update = ((entry.status() == Entry::Updateable) || (entry.status() == Entry::Updating));
 
             if (QFile::exists(installpath)) {
-                if (!update) {
+                if (!update && interactive) {
                     if (KMessageBox::warningContinueCancel(0, i18n("Overwrite existing file?") + "\n'" + installpath + '\'', i18n("Download File")) == KMessageBox::Cancel) {
                         return QStringList();
                     }
                 }
                 success = QFile::remove(installpath);
             }
-            if (success) {
+            if (success && keepPayload) {
+                success = linkOrCopyFile(payloadfile, installpath);
+            } else if (success) {
                 success = file.rename(installpath);
                 qCDebug(KNEWSTUFF) << "move: " << file.fileName() << " to " << installpath;
             }
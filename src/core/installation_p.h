@@ -65,6 +65,13 @@ public:
     bool readConfig(const KConfigGroup &group);
     bool isRemote() const;
 
+    /**
+     * Whether the user may be asked questions during installation (the default).
+     * Without interaction existing files are overwritten and downloads that turn out
+     * to be web pages fail.
+     */
+    void setInteractive(bool interactive);
+
 public Q_SLOTS:
     /**
      * Downloads a payload file. The payload file matching most closely
@@ -112,16 +119,20 @@ public Q_SLOTS:
 
 Q_SIGNALS:
     void signalEntryChanged(const KNS3::EntryInternal &entry);
-    void signalInstallationFinished();
-    void signalInstallationFailed(const QString &message);
+    void signalInstallationFinished(const KNS3::EntryInternal &entry);
+    void signalInstallationFailed(const QString &message, const KNS3::EntryInternal &entry);
 
     void signalPayloadLoaded(QUrl payload); // FIXME: return Entry
 
 private:
-    void install(KNS3::EntryInternal entry, const QString &downloadedFile);
+    // with @p keepPayload the file is not ours (a payload on a local mirror) and is linked or copied instead of moved
+    void install(KNS3::EntryInternal entry, const QString &downloadedFile, bool keepPayload = false);
+    void resetStatus(KNS3::EntryInternal entry);
+    // false if @p payloadfile is a web page the application does not accept, the entry is marked invalid then
+    bool checkHtmlPayload(KNS3::EntryInternal entry, const QString &payloadfile, const QUrl &source);
 
     QString targetInstallationPath(const QString &payloadfile);
-    QStringList installDownloadedFileAndUncompress(const KNS3::EntryInternal  &entry, const QString &payloadfile, const QString installdir);
+    QStringList installDownloadedFileAndUncompress(const KNS3::EntryInternal  &entry, const QString &payloadfile, const QString installdir, bool keepPayload);
     void runPostInstallationCommand(const QString &installPath);
 
     static QStringList archiveEntries(const QString &path, const KArchiveDirectory *dir);
@@ -150,6 +161,7 @@ private:
     // FIXME this throws together a file name from entry name and version - why would anyone want that?
     bool customName;
     bool acceptHtml;
+    bool interactive;
 
     QMap<KJob *, EntryInternal> entry_jobs;
 
@@ -0,0 +1,160 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "jobscheduler_p.h"
+
+#include <knewstuff_debug.h>
+
+using namespace KNS3;
+
+JobScheduler::JobScheduler(QObject *parent)
+    : QObject(parent)
+    , m_maximumJobsPerHost(6)
+    , m_nextTicket(1)
+    , m_starting(false)
+{
+    m_maximumJobs[Metadata] = 8;
+    m_maximumJobs[UpdateCheck] = 2;
+    m_maximumJobs[Payload] = 2;
+    m_maximumJobs[Preview] = 4;
+    for (int i = 0; i < ClassCount; ++i) {
+        m_running[i] = 0;
+    }
+}
+
+JobScheduler::~JobScheduler()
+{
+}
+
+void JobScheduler::setMaximumJobs(JobClass jobClass, int count)
+{
+    m_maximumJobs[jobClass] = qMax(1, count);
+    startJobs();
+}
+
+void JobScheduler::setMaximumJobsPerHost(int count)
+{
+    m_maximumJobsPerHost = qMax(1, count);
+    startJobs();
+}
+
+int JobScheduler::schedule(JobClass jobClass, const QString &host, int priority, const StartFunction &start)
+{
+    Job job;
+    job.ticket = m_nextTicket++;
+    job.jobClass = jobClass;
+    job.host = host;
+    job.priority = priority;
+    job.start = start;
+
+    QList<Job> &queue = m_queued[jobClass];
+    int i = queue.size();
+    while (i > 0 && queue.at(i - 1).priority < priority) {
+        --i;
+    }
+    queue.insert(i, job);
+
+    startJobs();
+    emit statusChanged();
+    return job.ticket;
+}
+
+void JobScheduler::finished(int ticket)
+{
+    QHash<int, Job>::iterator it = m_runningJobs.find(ticket);
+    if (it == m_runningJobs.end()) {
+        return;
+    }
+    --m_running[it->jobClass];
+    if (!it->host.isEmpty() && --m_jobsPerHost[it->host] == 0) {
+        m_jobsPerHost.remove(it->host);
+    }
+    m_runningJobs.erase(it);
+
+    startJobs();
+    emit statusChanged();
+}
+
+bool JobScheduler::cancel(int ticket)
+{
+    for (int c = 0; c < ClassCount; ++c) {
+        QList<Job> &queue = m_queued[c];
+        for (int i = 0; i < queue.size(); ++i) {
+            if (queue.at(i).ticket == ticket) {
+                queue.removeAt(i);
+                emit statusChanged();
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void JobScheduler::cancelQueued(JobClass jobClass)
+{
+    if (m_queued[jobClass].isEmpty()) {
+        return;
+    }
+    qCDebug(KNEWSTUFF) << "Cancelling" << m_queued[jobClass].size() << "queued jobs of class" << jobClass;
+    m_queued[jobClass].clear();
+    emit statusChanged();
+}
+
+int JobScheduler::runningJobs(JobClass jobClass) const
+{
+    return m_running[jobClass];
+}
+
+int JobScheduler::pendingJobs(JobClass jobClass) const
+{
+    return m_running[jobClass] + m_queued[jobClass].size();
+}
+
+void JobScheduler::startJobs()
+{
+    // start functions may finish their job synchronously, which calls back into here
+    if (m_starting) {
+        return;
+    }
+    m_starting = true;
+
+    bool started = true;
+    while (started) {
+        started = false;
+        // the classes are ordered by importance
+        for (int c = 0; c < ClassCount; ++c) {
+            QList<Job> &queue = m_queued[c];
+            for (int i = 0; i < queue.size() && m_running[c] < m_maximumJobs[c]; ++i) {
+                const QString &host = queue.at(i).host;
+                if (!host.isEmpty() && m_jobsPerHost.value(host) >= m_maximumJobsPerHost) {
+                    continue;
+                }
+                const Job job = queue.takeAt(i);
+                ++m_running[c];
+                if (!job.host.isEmpty()) {
+                    ++m_jobsPerHost[job.host];
+                }
+                m_runningJobs.insert(job.ticket, job);
+                job.start(job.ticket);
+                started = true;
+                break;
+            }
+        }
+    }
+
+    m_starting = false;
+}
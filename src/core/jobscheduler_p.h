@@ -0,0 +1,136 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef KNEWSTUFF3_JOBSCHEDULER_P_H
+#define KNEWSTUFF3_JOBSCHEDULER_P_H
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+#include <functional>
+
+namespace KNS3
+{
+
+/**
+ * Decides when the network work of the engine is started.
+ *
+ * Every job belongs to a class. Each class has its own concurrency limit, so
+ * for example the metadata of a page never waits for preview downloads.
+ * Additionally the number of jobs per host is limited. Queued jobs of a
+ * class are started by priority, and in the order they were scheduled
+ * for equal priorities.
+ *
+ * The scheduler does not know about the jobs themselves, it calls the start
+ * function of a job when there is room for it, and the owner reports back
+ * with finished() when the job is done.
+ *
+ * @internal
+ */
+class JobScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum JobClass {
+        Metadata,
+        UpdateCheck,
+        Payload,
+        Preview
+    };
+
+    // starts the job, gets the ticket of the job
+    typedef std::function<void(int)> StartFunction;
+
+    explicit JobScheduler(QObject *parent = 0);
+    ~JobScheduler();
+
+    /**
+     * How many jobs of @p jobClass may run at the same time.
+     */
+    void setMaximumJobs(JobClass jobClass, int count);
+
+    /**
+     * How many jobs may run at the same time against one host, over all classes.
+     */
+    void setMaximumJobsPerHost(int count);
+
+    /**
+     * Queue a job. @p start is called once the limits allow it, possibly right away.
+     * @param host the host the job talks to, may be empty if it is not known
+     * @param priority jobs with a higher priority are started first
+     * @return a ticket to pass to finished() or cancel()
+     */
+    int schedule(JobClass jobClass, const QString &host, int priority, const StartFunction &start);
+
+    /**
+     * The job of @p ticket is done, its slot is free for the next one.
+     */
+    void finished(int ticket);
+
+    /**
+     * Drop a job that has not been started yet.
+     * @return false if the job is already running or unknown
+     */
+    bool cancel(int ticket);
+
+    /**
+     * Drop all jobs of @p jobClass that have not been started yet.
+     */
+    void cancelQueued(JobClass jobClass);
+
+    /// Number of running jobs of @p jobClass
+    int runningJobs(JobClass jobClass) const;
+    /// Number of running and queued jobs of @p jobClass
+    int pendingJobs(JobClass jobClass) const;
+
+Q_SIGNALS:
+    /**
+     * A job was scheduled, started, finished or cancelled.
+     */
+    void statusChanged();
+
+private:
+    struct Job {
+        int ticket;
+        JobClass jobClass;
+        QString host;
+        int priority;
+        StartFunction start;
+    };
+
+    void startJobs();
+
+    static const int ClassCount = Preview + 1;
+
+    int m_maximumJobs[ClassCount];
+    int m_maximumJobsPerHost;
+    int m_running[ClassCount];
+    // sorted by priority, then by ticket
+    QList<Job> m_queued[ClassCount];
+    // running jobs: ticket -> job
+    QHash<int, Job> m_runningJobs;
+    QHash<QString, int> m_jobsPerHost;
+    int m_nextTicket;
+    bool m_starting;
+};
+
+}
+
+#endif
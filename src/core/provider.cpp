@@ -39,6 +39,7 @@ QString Provider::SearchRequest::hashForRequest() const
 }
 
 Provider::Provider()
+    : mInteractive(true)
 {}
 
 Provider::~Provider()
@@ -54,5 +55,15 @@ QUrl Provider::icon() const
     return mIcon;
 }
 
+void Provider::setInteractive(bool interactive)
+{
+    mInteractive = interactive;
+}
+
+bool Provider::isInteractive() const
+{
+    return mInteractive;
+}
+
 }
 
@@ -71,6 +71,16 @@ public:
             : sortMode(sortMode_), searchTerm(searchTerm_), categories(categories_), page(page_), pageSize(pageSize_)
         {}
 
+        bool operator==(const SearchRequest &other) const
+        {
+            return sortMode == other.sortMode && page == other.page && pageSize == other.pageSize
+                   && searchTerm == other.searchTerm && categories == other.categories;
+        }
+        bool operator!=(const SearchRequest &other) const
+        {
+            return !(*this == other);
+        }
+
         QString hashForRequest() const;
     };
 
@@ -122,9 +132,24 @@ public:
      * Note: the engine connects to loadingFinished() signal to get the result
      */
     virtual void loadEntries(const KNS3::Provider::SearchRequest &request) = 0;
+    /**
+     * The result of @p request is not needed anymore, stop working on it.
+     * No loadingFinished() or loadingFailed() must be emitted for it afterwards.
+     */
+    virtual void abortRequest(const KNS3::Provider::SearchRequest &request)
+    {
+        Q_UNUSED(request)
+    }
     virtual void loadEntryDetails(const KNS3::EntryInternal &) {}
     virtual void loadPayloadLink(const EntryInternal &entry, int linkId) = 0;
 
+    /**
+     * Whether the provider may ask the user questions, for example before buying an item (the default).
+     * Without interaction payload links that need an answer fail.
+     */
+    void setInteractive(bool interactive);
+    bool isInteractive() const;
+
     virtual bool userCanVote()
     {
         return false;
@@ -147,10 +172,17 @@ Q_SIGNALS:
     void providerInitialized(KNS3::Provider *);
 
     void loadingFinished(const KNS3::Provider::SearchRequest &, const KNS3::EntryInternal::List &) const;
+    /**
+     * Entries found so far for a request that is still loading, so they can be shown early.
+     * loadingFinished() still delivers the complete result.
+     */
+    void loadingProgress(const KNS3::Provider::SearchRequest &, const KNS3::EntryInternal::List &) const;
     void loadingFailed(const KNS3::Provider::SearchRequest &);
 
     void entryDetailsLoaded(const KNS3::EntryInternal &);
     void payloadLinkLoaded(const KNS3::EntryInternal &);
+    // the payload link of the entry cannot be given, the installation does not start
+    void payloadLinkFailed(const KNS3::EntryInternal &);
 
     void signalInformation(const QString &) const;
     void signalError(const QString &) const;
@@ -160,8 +192,22 @@ protected:
     QUrl mIcon;
 
 private:
+    bool mInteractive;
+
     Q_DISABLE_COPY(Provider)
 };
+
+/**
+ * Allows using search requests as keys, e.g. to find identical requests that are in flight
+ */
+inline uint qHash(const KNS3::Provider::SearchRequest &request, uint seed = 0)
+{
+    uint h = ::qHash(request.searchTerm, seed) ^ ::qHash(int(request.sortMode), seed);
+    foreach (const QString &category, request.categories) {
+        h = 31 * h + ::qHash(category, seed);
+    }
+    return h ^ ::qHash(request.page, seed) ^ ::qHash(request.pageSize << 16, seed);
+}
 }
 
 #endif
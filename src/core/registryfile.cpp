@@ -0,0 +1,370 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "registryfile_p.h"
+
+#include <QtCore/QSaveFile>
+#include <QtCore/QtEndian>
+#include <knewstuff_debug.h>
+
+#include <cstring>
+
+using namespace KNS3;
+
+static const char Magic[4] = { 'K', 'N', 'S', 'R' };
+static const quint32 Version = 1;
+
+enum HeaderField {
+    HeaderMagic,
+    HeaderVersion,
+    HeaderSectionCount,
+    HeaderRecordCount,
+    HeaderFileCount,
+    HeaderStringCount,
+    HeaderStringDataSize,
+    HeaderSize
+};
+
+// the fields of a record, strings first
+enum RecordField {
+    FieldUniqueId,
+    FieldName,
+    FieldCategory,
+    FieldAuthorName,
+    FieldAuthorEmail,
+    FieldAuthorJabber,
+    FieldAuthorHomepage,
+    FieldHomepage,
+    FieldLicense,
+    FieldVersion,
+    FieldSummary,
+    FieldChangelog,
+    FieldPreview,
+    FieldPreviewBig,
+    FieldPayload,
+    FieldChecksum,
+    FieldSignature,
+    StringFieldCount,
+    FieldReleaseDate = StringFieldCount, // julian day, 0 if not set
+    FieldRating,
+    FieldDownloads,
+    FieldStatus,
+    FieldFirstFile,
+    FieldFileCount,
+    RecordSize
+};
+
+static const int SectionSize = 3;
+
+RegistryFile::RegistryFile(const QString &fileName)
+    : m_file(fileName)
+    , m_data(0)
+    , m_size(0)
+    , m_recordsOffset(0)
+    , m_filesOffset(0)
+    , m_stringsOffset(0)
+    , m_stringDataOffset(0)
+    , m_recordCount(0)
+    , m_fileCount(0)
+    , m_stringCount(0)
+{
+}
+
+RegistryFile::~RegistryFile()
+{
+    close();
+}
+
+bool RegistryFile::open()
+{
+    close();
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    m_size = m_file.size();
+    if (m_size < HeaderSize * 4) {
+        close();
+        return false;
+    }
+    m_data = m_file.map(0, m_size);
+    if (!m_data || memcmp(m_data, Magic, sizeof(Magic)) != 0) {
+        close();
+        return false;
+    }
+    const quint32 version = word(HeaderVersion * 4);
+    if (version != Version) {
+        qCDebug(KNEWSTUFF) << "Unknown registry version" << version << "in" << m_file.fileName();
+        close();
+        return false;
+    }
+
+    const quint32 sectionCount = word(HeaderSectionCount * 4);
+    m_recordCount = word(HeaderRecordCount * 4);
+    m_fileCount = word(HeaderFileCount * 4);
+    m_stringCount = word(HeaderStringCount * 4);
+    const quint32 stringDataSize = word(HeaderStringDataSize * 4);
+
+    const qint64 sectionsOffset = HeaderSize * 4;
+    const qint64 recordsOffset = sectionsOffset + qint64(sectionCount) * SectionSize * 4;
+    const qint64 filesOffset = recordsOffset + qint64(m_recordCount) * RecordSize * 4;
+    const qint64 stringsOffset = filesOffset + qint64(m_fileCount) * 4;
+    const qint64 stringDataOffset = stringsOffset + qint64(m_stringCount) * 2 * 4;
+    if (stringDataOffset + stringDataSize != m_size) {
+        qWarning() << "The registry" << m_file.fileName() << "is truncated or corrupt.";
+        close();
+        return false;
+    }
+    m_recordsOffset = recordsOffset;
+    m_filesOffset = filesOffset;
+    m_stringsOffset = stringsOffset;
+    m_stringDataOffset = stringDataOffset;
+
+    for (quint32 i = 0; i < sectionCount; ++i) {
+        const qint64 offset = sectionsOffset + qint64(i) * SectionSize * 4;
+        Section section;
+        section.firstRecord = word(offset + 4);
+        section.recordCount = word(offset + 8);
+        if (qint64(section.firstRecord) + section.recordCount > m_recordCount) {
+            qWarning() << "The registry" << m_file.fileName() << "is corrupt.";
+            close();
+            return false;
+        }
+        m_sections.insert(string(word(offset)), section);
+    }
+    return true;
+}
+
+void RegistryFile::close()
+{
+    if (m_data) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+        m_data = 0;
+    }
+    m_file.close();
+    m_size = 0;
+    m_sections.clear();
+}
+
+bool RegistryFile::isOpen() const
+{
+    return m_data != 0;
+}
+
+QStringList RegistryFile::providerIds() const
+{
+    return m_sections.keys();
+}
+
+EntryInternal::List RegistryFile::entries(const QString &providerId) const
+{
+    EntryInternal::List entries;
+    QHash<QString, Section>::const_iterator it = m_sections.constFind(providerId);
+    if (it == m_sections.constEnd()) {
+        return entries;
+    }
+    entries.reserve(it->recordCount);
+    for (quint32 i = 0; i < it->recordCount; ++i) {
+        entries.append(record(it->firstRecord + i, providerId));
+    }
+    return entries;
+}
+
+quint32 RegistryFile::word(qint64 offset) const
+{
+    return qFromLittleEndian<quint32>(m_data + offset);
+}
+
+QString RegistryFile::string(quint32 index) const
+{
+    if (index >= m_stringCount) {
+        return QString();
+    }
+    const qint64 entry = m_stringsOffset + qint64(index) * 2 * 4;
+    const qint64 offset = m_stringDataOffset + qint64(word(entry));
+    const quint32 size = word(entry + 4);
+    if (offset + size > m_size) {
+        return QString();
+    }
+    return QString::fromUtf8(reinterpret_cast<const char *>(m_data + offset), size);
+}
+
+EntryInternal RegistryFile::record(quint32 index, const QString &providerId) const
+{
+    const qint64 offset = m_recordsOffset + qint64(index) * RecordSize * 4;
+    const auto field = [this, offset](int field) {
+        return word(offset + field * 4);
+    };
+
+    EntryInternal entry;
+    entry.setProviderId(providerId);
+    entry.setUniqueId(string(field(FieldUniqueId)));
+    entry.setName(string(field(FieldName)));
+    entry.setCategory(string(field(FieldCategory)));
+    Author author;
+    author.setName(string(field(FieldAuthorName)));
+    author.setEmail(string(field(FieldAuthorEmail)));
+    author.setJabber(string(field(FieldAuthorJabber)));
+    author.setHomepage(string(field(FieldAuthorHomepage)));
+    entry.setAuthor(author);
+    entry.setHomepage(QUrl(string(field(FieldHomepage))));
+    entry.setLicense(string(field(FieldLicense)));
+    entry.setVersion(string(field(FieldVersion)));
+    entry.setSummary(string(field(FieldSummary)));
+    entry.setChangelog(string(field(FieldChangelog)));
+    entry.setPreviewUrl(string(field(FieldPreview)), EntryInternal::PreviewSmall1);
+    entry.setPreviewUrl(string(field(FieldPreviewBig)), EntryInternal::PreviewBig1);
+    entry.setPayload(string(field(FieldPayload)));
+    entry.setChecksum(string(field(FieldChecksum)));
+    entry.setSignature(string(field(FieldSignature)));
+    if (field(FieldReleaseDate) != 0) {
+        entry.setReleaseDate(QDate::fromJulianDay(field(FieldReleaseDate)));
+    }
+    entry.setRating(qint32(field(FieldRating)));
+    entry.setDownloadCount(qint32(field(FieldDownloads)));
+    entry.setStatus(field(FieldStatus) == quint32(Entry::Updateable) ? Entry::Updateable : Entry::Installed);
+
+    const quint32 firstFile = field(FieldFirstFile);
+    const quint32 fileCount = field(FieldFileCount);
+    if (qint64(firstFile) + fileCount <= m_fileCount) {
+        QStringList files;
+        files.reserve(fileCount);
+        for (quint32 i = 0; i < fileCount; ++i) {
+            files.append(string(word(m_filesOffset + qint64(firstFile + i) * 4)));
+        }
+        entry.setInstalledFiles(files);
+    }
+    entry.setSource(EntryInternal::Cache);
+    return entry;
+}
+
+namespace
+{
+// collects the distinct strings of a registry that is being written
+class StringTable
+{
+public:
+    quint32 index(const QString &string)
+    {
+        QHash<QString, quint32>::const_iterator it = m_indexes.constFind(string);
+        if (it != m_indexes.constEnd()) {
+            return it.value();
+        }
+        const QByteArray utf8 = string.toUtf8();
+        const quint32 index = m_indexes.size();
+        m_indexes.insert(string, index);
+        m_offsets.append(m_data.size());
+        m_offsets.append(utf8.size());
+        m_data.append(utf8);
+        return index;
+    }
+
+    QVector<quint32> m_offsets;
+    QByteArray m_data;
+
+private:
+    QHash<QString, quint32> m_indexes;
+};
+}
+
+static void appendWords(QByteArray &data, const QVector<quint32> &words)
+{
+    const int offset = data.size();
+    data.resize(offset + words.size() * 4);
+    uchar *out = reinterpret_cast<uchar *>(data.data()) + offset;
+    foreach (quint32 word, words) {
+        qToLittleEndian(word, out);
+        out += 4;
+    }
+}
+
+QByteArray RegistryFile::encode(const EntryInternal::List &entries)
+{
+    QHash<QString, EntryInternal::List> byProvider;
+    foreach (const EntryInternal &entry, entries) {
+        byProvider[entry.providerId()].append(entry);
+    }
+
+    StringTable strings;
+    QVector<quint32> sections;
+    QVector<quint32> records;
+    QVector<quint32> files;
+    records.reserve(entries.size() * RecordSize);
+
+    for (QHash<QString, EntryInternal::List>::const_iterator it = byProvider.constBegin(); it != byProvider.constEnd(); ++it) {
+        sections << strings.index(it.key()) << records.size() / RecordSize << it->size();
+        foreach (const EntryInternal &entry, it.value()) {
+            const QDate releaseDate = entry.releaseDate();
+            const QStringList installedFiles = entry.installedFiles();
+            records << strings.index(entry.uniqueId())
+                    << strings.index(entry.name())
+                    << strings.index(entry.category())
+                    << strings.index(entry.author().name())
+                    << strings.index(entry.author().email())
+                    << strings.index(entry.author().jabber())
+                    << strings.index(entry.author().homepage())
+                    << strings.index(entry.homepage().url())
+                    << strings.index(entry.license())
+                    << strings.index(entry.version())
+                    << strings.index(entry.summary())
+                    << strings.index(entry.changelog())
+                    << strings.index(entry.previewUrl(EntryInternal::PreviewSmall1))
+                    << strings.index(entry.previewUrl(EntryInternal::PreviewBig1))
+                    << strings.index(entry.payload())
+                    << strings.index(entry.checksum())
+                    << strings.index(entry.signature())
+                    << (releaseDate.isValid() ? quint32(releaseDate.toJulianDay()) : 0)
+                    << quint32(entry.rating())
+                    << quint32(entry.downloadCount())
+                    << quint32(entry.status())
+                    << files.size()
+                    << installedFiles.size();
+            foreach (const QString &file, installedFiles) {
+                files << strings.index(file);
+            }
+        }
+    }
+
+    QVector<quint32> header(HeaderSize);
+    header[HeaderVersion] = Version;
+    header[HeaderSectionCount] = byProvider.size();
+    header[HeaderRecordCount] = records.size() / RecordSize;
+    header[HeaderFileCount] = files.size();
+    header[HeaderStringCount] = strings.m_offsets.size() / 2;
+    header[HeaderStringDataSize] = strings.m_data.size();
+
+    QByteArray data;
+    appendWords(data, header);
+    // the magic is stored as bytes, not as a number
+    memcpy(data.data(), Magic, sizeof(Magic));
+    appendWords(data, sections);
+    appendWords(data, records);
+    appendWords(data, files);
+    appendWords(data, strings.m_offsets);
+    data.append(strings.m_data);
+    return data;
+}
+
+bool RegistryFile::write(const QString &fileName, const QByteArray &data)
+{
+    QSaveFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write meta information to '" << fileName << "'." << endl;
+        return false;
+    }
+    f.write(data);
+    return f.commit();
+}
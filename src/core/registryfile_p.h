@@ -0,0 +1,98 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef KNEWSTUFF3_REGISTRYFILE_P_H
+#define KNEWSTUFF3_REGISTRYFILE_P_H
+
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+
+#include "entryinternal_p.h"
+
+namespace KNS3
+{
+
+/**
+ * @short Binary registry of installed entries.
+ *
+ * The file is memory mapped and entries are only decoded when the entries
+ * of their provider are asked for.
+ *
+ * Layout (all numbers are 32 bit little endian):
+ * - header: magic "KNSR", version, section count, record count,
+ *   file list length, string count, string data size
+ * - sections: provider id string, first record, record count
+ * - records: a fixed number of fields, strings are indexes into the string table
+ * - file list: string indexes of the installed files, records refer to a range of it
+ * - string table: offset and size into the string data
+ * - string data: UTF-8, every distinct string is stored once
+ *
+ * @internal
+ */
+class RegistryFile
+{
+public:
+    explicit RegistryFile(const QString &fileName);
+    ~RegistryFile();
+
+    /**
+     * Map the file.
+     * @return false if the file does not exist or is not a valid registry of a known version
+     */
+    bool open();
+    void close();
+    bool isOpen() const;
+
+    /// The providers that have entries in the file
+    QStringList providerIds() const;
+    /// Decode the entries of @p providerId
+    EntryInternal::List entries(const QString &providerId) const;
+
+    /// The registry of @p entries
+    static QByteArray encode(const EntryInternal::List &entries);
+    /// Replace @p fileName with the encoded registry @p data, safe to call from any thread
+    static bool write(const QString &fileName, const QByteArray &data);
+
+private:
+    struct Section {
+        quint32 firstRecord;
+        quint32 recordCount;
+    };
+
+    quint32 word(qint64 offset) const;
+    QString string(quint32 index) const;
+    EntryInternal record(quint32 index, const QString &providerId) const;
+
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+
+    quint32 m_recordsOffset;
+    quint32 m_filesOffset;
+    quint32 m_stringsOffset;
+    quint32 m_stringDataOffset;
+    quint32 m_recordCount;
+    quint32 m_fileCount;
+    quint32 m_stringCount;
+    QHash<QString, Section> m_sections;
+
+    Q_DISABLE_COPY(RegistryFile)
+};
+
+}
+
+#endif
@@ -0,0 +1,213 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "registryjournal_p.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QtEndian>
+#include <knewstuff_debug.h>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace KNS3;
+
+// every record starts with its size (32 bit) and checksum (16 bit)
+static const int FrameHeaderSize = 6;
+// the record itself starts with the version of its layout, which has to change with the
+// stream operators of EntryInternal
+static const quint8 RecordVersion = 1;
+
+static bool syncToDisk(QFile &file)
+{
+    if (!file.flush()) {
+        return false;
+    }
+#if defined(Q_OS_WIN)
+    return FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(file.handle())));
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
+static bool decodeRecord(const QByteArray &data, RegistryJournal::Record &record)
+{
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_5);
+
+    quint8 version;
+    quint8 operation;
+    stream >> version >> operation;
+    if (version != RecordVersion) {
+        // an entry of another layout would be misread
+        return false;
+    }
+    record.operation = RegistryJournal::Operation(operation);
+    if (record.operation == RegistryJournal::Remove) {
+        QString providerId;
+        QString uniqueId;
+        stream >> providerId >> uniqueId;
+        record.entry.setProviderId(providerId);
+        record.entry.setUniqueId(uniqueId);
+    } else if (record.operation == RegistryJournal::Put) {
+        stream >> record.entry;
+    } else {
+        return false;
+    }
+    record.entry.setSource(EntryInternal::Cache);
+    return stream.status() == QDataStream::Ok;
+}
+
+RegistryJournal::RegistryJournal(const QString &fileName)
+    : m_file(fileName)
+    , m_recordCount(0)
+{
+}
+
+RegistryJournal::~RegistryJournal()
+{
+}
+
+QList<RegistryJournal::Record> RegistryJournal::replay()
+{
+    QList<Record> records;
+    m_file.close();
+    m_recordCount = 0;
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return records;
+    }
+    const QByteArray data = m_file.readAll();
+    m_file.close();
+
+    int offset = 0;
+    while (data.size() - offset >= FrameHeaderSize) {
+        const uchar *header = reinterpret_cast<const uchar *>(data.constData() + offset);
+        const quint32 size = qFromLittleEndian<quint32>(header);
+        const quint16 checksum = qFromLittleEndian<quint16>(header + 4);
+        if (size > quint32(data.size() - offset - FrameHeaderSize)) {
+            break;
+        }
+        const char *payload = data.constData() + offset + FrameHeaderSize;
+        if (qChecksum(payload, size) != checksum) {
+            break;
+        }
+        Record record;
+        if (decodeRecord(QByteArray::fromRawData(payload, size), record)) {
+            records.append(record);
+        } else {
+            qWarning() << "Skipping unknown or outdated record in registry journal" << m_file.fileName();
+        }
+        offset += FrameHeaderSize + size;
+        ++m_recordCount;
+    }
+
+    if (offset < data.size()) {
+        // new records have to follow the last complete one
+        qWarning() << "Dropping incomplete record at the end of registry journal" << m_file.fileName();
+        m_file.resize(offset);
+    }
+    return records;
+}
+
+QByteArray RegistryJournal::record(const EntryInternal &entry)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_5);
+
+    stream << RecordVersion;
+    if (entry.status() == Entry::Installed || entry.status() == Entry::Updateable) {
+        stream << quint8(Put) << entry;
+    } else {
+        stream << quint8(Remove) << entry.providerId() << entry.uniqueId();
+    }
+    return data;
+}
+
+bool RegistryJournal::openForAppend()
+{
+    if (m_file.isOpen()) {
+        return true;
+    }
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Cannot open registry journal" << m_file.fileName() << m_file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool RegistryJournal::append(const QByteArray &record)
+{
+    if (!openForAppend()) {
+        return false;
+    }
+
+    QByteArray frame(FrameHeaderSize, 0);
+    uchar *header = reinterpret_cast<uchar *>(frame.data());
+    qToLittleEndian<quint32>(record.size(), header);
+    qToLittleEndian<quint16>(qChecksum(record.constData(), record.size()), header + 4);
+    frame.append(record);
+
+    if (m_file.write(frame) != frame.size() || !syncToDisk(m_file)) {
+        qWarning() << "Cannot write to registry journal" << m_file.fileName() << m_file.errorString();
+        return false;
+    }
+    ++m_recordCount;
+    return true;
+}
+
+int RegistryJournal::recordCount() const
+{
+    return m_recordCount;
+}
+
+bool RegistryJournal::moveTo(const QString &fileName)
+{
+    m_file.close();
+    if (!m_file.exists()) {
+        m_recordCount = 0;
+        return true;
+    }
+
+    if (!QFile::exists(fileName)) {
+        const QString journalFileName = m_file.fileName();
+        if (!m_file.rename(fileName)) {
+            return false;
+        }
+        // the QFile follows the rename, new records go to a new journal
+        m_file.setFileName(journalFileName);
+    } else {
+        // the records of an earlier move have not been folded into the registry yet, keep their order
+        QFile target(fileName);
+        if (!m_file.open(QIODevice::ReadOnly) || !target.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            m_file.close();
+            return false;
+        }
+        const QByteArray data = m_file.readAll();
+        m_file.close();
+        if (target.write(data) != data.size() || !syncToDisk(target)) {
+            return false;
+        }
+        m_file.remove();
+    }
+    m_recordCount = 0;
+    return true;
+}
@@ -0,0 +1,84 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef KNEWSTUFF3_REGISTRYJOURNAL_P_H
+#define KNEWSTUFF3_REGISTRYJOURNAL_P_H
+
+#include <QtCore/QFile>
+
+#include "entryinternal_p.h"
+
+namespace KNS3
+{
+
+/**
+ * @short Append-only journal of changes to the registry of installed entries.
+ *
+ * Every record holds the complete state of one entry and is on disk when
+ * append() returns. Replaying the journal over the registry it was started
+ * from gives the current registry.
+ *
+ * @internal
+ */
+class RegistryJournal
+{
+public:
+    enum Operation {
+        Put = 1,
+        Remove = 2
+    };
+
+    struct Record {
+        Operation operation;
+        EntryInternal entry;
+    };
+
+    explicit RegistryJournal(const QString &fileName);
+    ~RegistryJournal();
+
+    /**
+     * Read the records of the journal.
+     * An incomplete record at the end, left by a crash while writing it, is dropped.
+     * Records of another layout version are skipped.
+     */
+    QList<Record> replay();
+
+    /// The record for @p entry, Put for installed entries, Remove otherwise
+    static QByteArray record(const EntryInternal &entry);
+    /// Append @p record and flush it to the disk
+    bool append(const QByteArray &record);
+    /// Records in the journal
+    int recordCount() const;
+
+    /**
+     * Move the records to the journal @p fileName (appending to it if it exists)
+     * and start over with an empty journal.
+     */
+    bool moveTo(const QString &fileName);
+
+private:
+    bool openForAppend();
+
+    QFile m_file;
+    int m_recordCount;
+
+    Q_DISABLE_COPY(RegistryJournal)
+};
+
+}
+
+#endif
@@ -0,0 +1,177 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "resultmerger_p.h"
+
+#include <QtCore/QVector>
+
+#include <knewstuff_debug.h>
+
+using namespace KNS3;
+
+ResultMerger::ResultMerger()
+{
+}
+
+void ResultMerger::reset()
+{
+    m_pending.clear();
+    m_seenIds.clear();
+    m_seenFingerprints.clear();
+}
+
+void ResultMerger::expect(const Provider::SearchRequest &request, const QString &providerId)
+{
+    m_pending[request].waitingFor.insert(providerId);
+}
+
+bool ResultMerger::isPending(const Provider::SearchRequest &request) const
+{
+    return m_pending.contains(request);
+}
+
+bool ResultMerger::hasMorePages(const Provider::SearchRequest &request) const
+{
+    return m_pending.value(request).morePages;
+}
+
+bool ResultMerger::addResults(const Provider::SearchRequest &request, const QString &providerId, const EntryInternal::List &entries)
+{
+    QHash<Provider::SearchRequest, PendingPage>::iterator it = m_pending.find(request);
+    if (it == m_pending.end() || !it->waitingFor.remove(providerId)) {
+        // an answer to a request that was superseded in the meantime
+        qCDebug(KNEWSTUFF) << "Dropping stale results from" << providerId << request.hashForRequest();
+        return false;
+    }
+    it->batches.insert(providerId, entries);
+    if (entries.size() >= request.pageSize) {
+        it->morePages = true;
+    }
+    return it->waitingFor.isEmpty();
+}
+
+bool ResultMerger::addFailure(const Provider::SearchRequest &request, const QString &providerId)
+{
+    QHash<Provider::SearchRequest, PendingPage>::iterator it = m_pending.find(request);
+    if (it == m_pending.end() || !it->waitingFor.remove(providerId)) {
+        return false;
+    }
+    it->failed = true;
+    return it->waitingFor.isEmpty();
+}
+
+bool ResultMerger::hasFailures(const Provider::SearchRequest &request) const
+{
+    return m_pending.value(request).failed;
+}
+
+EntryInternal::List ResultMerger::takePage(const Provider::SearchRequest &request)
+{
+    const PendingPage page = m_pending.take(request);
+
+    // the batches are kept in a map, so the provider order and thus the
+    // order of entries that compare equal does not depend on network timing
+    QList<EntryInternal::List> batches = page.batches.values();
+    QVector<int> heads(batches.size(), 0);
+
+    int total = 0;
+    foreach (const EntryInternal::List &batch, batches) {
+        total += batch.size();
+    }
+
+    EntryInternal::List merged;
+    merged.reserve(total);
+
+    const bool sorted = request.sortMode != Provider::Updates;
+    while (true) {
+        int best = -1;
+        for (int i = 0; i < batches.size(); ++i) {
+            if (heads[i] >= batches[i].size()) {
+                continue;
+            }
+            if (best == -1) {
+                best = i;
+                if (!sorted) {
+                    break;
+                }
+            } else if (lessThan(request.sortMode, batches[i].at(heads[i]), batches[best].at(heads[best]))) {
+                best = i;
+            }
+        }
+        if (best == -1) {
+            break;
+        }
+
+        const EntryInternal &entry = batches[best].at(heads[best]++);
+
+        const QPair<QString, QString> id(entry.providerId(), entry.uniqueId());
+        if (m_seenIds.contains(id)) {
+            continue;
+        }
+        const QString print = fingerprint(entry);
+        const QString firstProvider = m_seenFingerprints.value(print);
+        if (!firstProvider.isEmpty() && firstProvider != entry.providerId()) {
+            qCDebug(KNEWSTUFF) << "Skipping" << entry.name() << "from" << entry.providerId() << "already provided by" << firstProvider;
+            continue;
+        }
+
+        m_seenIds.insert(id);
+        if (firstProvider.isEmpty()) {
+            m_seenFingerprints.insert(print, entry.providerId());
+        }
+        merged.append(entry);
+    }
+
+    qCDebug(KNEWSTUFF) << "Merged page" << request.page << "from" << batches.size() << "providers:" << total << "->" << merged.size();
+    return merged;
+}
+
+void ResultMerger::markSeen(const EntryInternal::List &entries)
+{
+    foreach (const EntryInternal &entry, entries) {
+        m_seenIds.insert(qMakePair(entry.providerId(), entry.uniqueId()));
+        const QString print = fingerprint(entry);
+        if (!m_seenFingerprints.contains(print)) {
+            m_seenFingerprints.insert(print, entry.providerId());
+        }
+    }
+}
+
+bool ResultMerger::lessThan(Provider::SortMode sortMode, const EntryInternal &left, const EntryInternal &right)
+{
+    switch (sortMode) {
+    case Provider::Newest:
+        return left.releaseDate() > right.releaseDate();
+    case Provider::Rating:
+        return left.rating() > right.rating();
+    case Provider::Downloads:
+        return left.downloadCount() > right.downloadCount();
+    case Provider::Alphabetical:
+    case Provider::Installed:
+        return QString::localeAwareCompare(left.name(), right.name()) < 0;
+    case Provider::Updates:
+        break;
+    }
+    return false;
+}
+
+QString ResultMerger::fingerprint(const EntryInternal &entry)
+{
+    return entry.name().simplified().toLower() + QLatin1Char('\n')
+           + entry.version() + QLatin1Char('\n')
+           + entry.author().name().simplified().toLower();
+}
@@ -0,0 +1,137 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef KNEWSTUFF3_RESULTMERGER_P_H
+#define KNEWSTUFF3_RESULTMERGER_P_H
+
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+
+#include "provider_p.h"
+#include "entryinternal_p.h"
+
+namespace KNS3
+{
+
+/**
+ * Merges the results of several providers into one ordered result stream.
+ *
+ * The engine sends every page request to all providers. Each provider
+ * answers with its own, already sorted, batch. The merger collects the
+ * batches of one page until every provider that was asked has answered,
+ * then k-way merges them according to the sort mode of the request.
+ *
+ * Entries are only handed out once per result sequence: an entry is dropped
+ * if the same (providerId, uniqueId) was already shown, or if another
+ * provider already delivered an entry with the same content fingerprint
+ * (mirrors that serve the same catalog).
+ *
+ * @internal
+ */
+class ResultMerger
+{
+public:
+    ResultMerger();
+
+    /**
+     * Start a new result sequence. Pending pages are dropped and
+     * all entries become new again.
+     */
+    void reset();
+
+    /**
+     * Register that @p request was sent to the provider with @p providerId.
+     * Must be called before the provider is asked, as providers may answer
+     * synchronously.
+     */
+    void expect(const Provider::SearchRequest &request, const QString &providerId);
+
+    /**
+     * Whether a page for @p request is still waiting for provider answers.
+     */
+    bool isPending(const Provider::SearchRequest &request) const;
+
+    /**
+     * Whether any provider returned a full page for @p request, so there might be more pages.
+     * Only meaningful for complete pages, before takePage().
+     */
+    bool hasMorePages(const Provider::SearchRequest &request) const;
+
+    /**
+     * Add the answer of one provider.
+     * @return true if the page is now complete and can be fetched with takePage()
+     */
+    bool addResults(const Provider::SearchRequest &request, const QString &providerId, const EntryInternal::List &entries);
+
+    /**
+     * Register that the provider with @p providerId failed to answer.
+     * The page lacks its entries and is not a complete result.
+     * @return true if the page is now complete and can be fetched with takePage()
+     */
+    bool addFailure(const Provider::SearchRequest &request, const QString &providerId);
+
+    /**
+     * Whether a provider failed to answer @p request.
+     * Only meaningful for complete pages, before takePage().
+     */
+    bool hasFailures(const Provider::SearchRequest &request) const;
+
+    /**
+     * Merge, deduplicate and return a complete page.
+     * The page is forgotten afterwards.
+     */
+    EntryInternal::List takePage(const Provider::SearchRequest &request);
+
+    /**
+     * Remember entries that were shown without going through the merger,
+     * for example pages that were taken from the cache.
+     */
+    void markSeen(const EntryInternal::List &entries);
+
+    /**
+     * Strict weak ordering used for @p sortMode. Ties keep the order of the providers.
+     */
+    static bool lessThan(Provider::SortMode sortMode, const EntryInternal &left, const EntryInternal &right);
+
+    /**
+     * A provider independent fingerprint of the entry's content, used to detect
+     * the same item being served by several providers.
+     */
+    static QString fingerprint(const EntryInternal &entry);
+
+private:
+    struct PendingPage {
+        PendingPage() : morePages(false), failed(false) {}
+        QSet<QString> waitingFor;
+        QMap<QString, EntryInternal::List> batches;
+        bool morePages;
+        bool failed;
+    };
+
+    // pages that have been requested
+    QHash<Provider::SearchRequest, PendingPage> m_pending;
+    // (providerId, uniqueId) of every entry handed out in this sequence
+    QSet<QPair<QString, QString> > m_seenIds;
+    // fingerprint -> provider that delivered it first
+    QHash<QString, QString> m_seenFingerprints;
+};
+
+}
+
+#endif
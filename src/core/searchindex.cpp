@@ -0,0 +1,155 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "searchindex_p.h"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace KNS3;
+
+static inline quint64 trigram(const QChar *c)
+{
+    return (quint64(c[0].unicode()) << 32) | (quint64(c[1].unicode()) << 16) | c[2].unicode();
+}
+
+// the distinct trigrams of the case folded text
+static QSet<quint64> trigrams(const QString &foldedText)
+{
+    QSet<quint64> result;
+    const QChar *data = foldedText.constData();
+    for (int i = 0; i + 3 <= foldedText.size(); ++i) {
+        result.insert(trigram(data + i));
+    }
+    return result;
+}
+
+SearchIndex::SearchIndex()
+{
+}
+
+void SearchIndex::insert(const EntryInternal &entry)
+{
+    if (entry.uniqueId().isEmpty()) {
+        return;
+    }
+    m_entries.append(entry);
+    m_ids.insert(entry.uniqueId(), m_entries.size() - 1);
+    index(m_entries.size() - 1);
+
+    if (m_entries.size() > 2 * m_ids.size() + 1024) {
+        rebuild();
+    }
+}
+
+void SearchIndex::remove(const EntryInternal &entry)
+{
+    // the postings are skipped from now on
+    m_ids.remove(entry.uniqueId());
+}
+
+void SearchIndex::clear()
+{
+    m_entries.clear();
+    m_ids.clear();
+    m_postings.clear();
+}
+
+int SearchIndex::size() const
+{
+    return m_ids.size();
+}
+
+void SearchIndex::index(int id)
+{
+    const EntryInternal &entry = m_entries.at(id);
+    // separate the fields, so no trigram spans two of them
+    const QString text = entry.name().toCaseFolded() + QLatin1Char('\n')
+                         + entry.summary().toCaseFolded() + QLatin1Char('\n')
+                         + entry.author().name().toCaseFolded();
+    foreach (quint64 t, trigrams(text)) {
+        m_postings[t].append(id);
+    }
+}
+
+void SearchIndex::rebuild()
+{
+    QVector<EntryInternal> entries;
+    entries.reserve(m_ids.size());
+    for (int id = 0; id < m_entries.size(); ++id) {
+        if (m_ids.value(m_entries.at(id).uniqueId(), -1) == id) {
+            entries.append(m_entries.at(id));
+        }
+    }
+    clear();
+    m_entries = entries;
+    for (int id = 0; id < m_entries.size(); ++id) {
+        m_ids.insert(m_entries.at(id).uniqueId(), id);
+        index(id);
+    }
+}
+
+QSet<EntryInternal> SearchIndex::search(const QString &term) const
+{
+    QSet<EntryInternal> result;
+    const QString folded = term.toCaseFolded();
+
+    QVector<int> candidates;
+    if (folded.size() < 3) {
+        candidates.reserve(m_ids.size());
+        foreach (int id, m_ids) {
+            candidates.append(id);
+        }
+    } else {
+        QList<const QVector<int> *> lists;
+        foreach (quint64 t, trigrams(folded)) {
+            QHash<quint64, QVector<int> >::const_iterator it = m_postings.constFind(t);
+            if (it == m_postings.constEnd()) {
+                return result;
+            }
+            lists.append(&it.value());
+        }
+        // intersect the shortest lists first
+        std::sort(lists.begin(), lists.end(), [](const QVector<int> *left, const QVector<int> *right) {
+            return left->size() < right->size();
+        });
+        candidates = *lists.first();
+        for (int i = 1; i < lists.size() && !candidates.isEmpty(); ++i) {
+            QVector<int> intersection;
+            std::set_intersection(candidates.constBegin(), candidates.constEnd(),
+                                  lists.at(i)->constBegin(), lists.at(i)->constEnd(),
+                                  std::back_inserter(intersection));
+            candidates = intersection;
+        }
+    }
+
+    // the trigrams only narrow the candidates down, the fields still have to contain the term
+    foreach (int id, candidates) {
+        const EntryInternal &entry = m_entries.at(id);
+        if (m_ids.value(entry.uniqueId(), -1) == id && matches(entry, term)) {
+            result.insert(entry);
+        }
+    }
+    return result;
+}
+
+bool SearchIndex::matches(const EntryInternal &entry, const QString &term)
+{
+    return entry.name().contains(term, Qt::CaseInsensitive)
+           || entry.summary().contains(term, Qt::CaseInsensitive)
+           || entry.author().name().contains(term, Qt::CaseInsensitive);
+}
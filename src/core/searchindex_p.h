@@ -0,0 +1,73 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef KNEWSTUFF3_SEARCHINDEX_P_H
+#define KNEWSTUFF3_SEARCHINDEX_P_H
+
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
+
+#include "entryinternal_p.h"
+
+namespace KNS3
+{
+
+/**
+ * @short Trigram index over the name, summary and author of entries.
+ *
+ * Answers which entries contain a search term (case insensitive, anywhere in
+ * one of the fields) without looking at every entry. Terms shorter than three
+ * characters are checked against all entries.
+ *
+ * Entries are identified by their unique id, inserting an entry again replaces
+ * the indexed version.
+ *
+ * @internal
+ */
+class SearchIndex
+{
+public:
+    SearchIndex();
+
+    void insert(const EntryInternal &entry);
+    void remove(const EntryInternal &entry);
+    void clear();
+    int size() const;
+
+    /// The indexed entries whose name, summary or author name contain @p term
+    QSet<EntryInternal> search(const QString &term) const;
+
+    /// Whether the name, summary or author name of @p entry contain @p term
+    static bool matches(const EntryInternal &entry, const QString &term);
+
+private:
+    // postings of replaced and removed entries are dropped when the index is rebuilt
+    void rebuild();
+    void index(int id);
+
+    // all versions of the entries that were indexed, the current one is in m_ids
+    QVector<EntryInternal> m_entries;
+    // unique id -> position in m_entries
+    QHash<QString, int> m_ids;
+    // trigram -> ascending positions in m_entries
+    QHash<quint64, QVector<int> > m_postings;
+};
+
+}
+
+#endif
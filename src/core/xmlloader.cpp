@@ -20,60 +20,533 @@
 */
 
 #include "xmlloader_p.h"
+#include "feedparser_p.h"
 
 #include <QtCore/QByteArray>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
 
+#include <kcompressiondevice.h>
 #include <kconfig.h>
+#include <kfilterbase.h>
+#include <karchive_version.h>
 #include <knewstuff_debug.h>
 #include <kio/job.h>
 
 namespace KNS3
 {
 
+static const quint32 CacheInfoMagic = 0x4b4e5358; // "KNSX"
+static const quint32 CacheInfoVersion = 1;
+// enough for the magic bytes and the gzip header
+static const int SniffSize = 512;
+// how much of a cached document is parsed at once
+static const int CacheChunkSize = 64 * 1024;
+// the cache directory is kept below this size (bytes)
+static const qint64 MaximumCacheSize = 64 * 1024 * 1024;
+// cached documents that have not been fetched or revalidated for this long (days) are removed
+static const int MaximumCacheAge = 30;
+
 XmlLoader::XmlLoader(QObject *parent)
     : QObject(parent)
+    , m_job(0)
+    , m_maxAge(0)
+    , m_cacheable(true)
+    , m_haveCache(false)
+    , m_loadingFromCache(false)
+    , m_formatKnown(false)
+    , m_filterFinished(false)
+    , m_decodeFailed(false)
+    , m_streaming(false)
+    , m_parser(0)
+    , m_aborted(false)
 {
 }
 
+XmlLoader::~XmlLoader()
+{
+    resetDecoding();
+}
+
+QUrl XmlLoader::url() const
+{
+    return m_url;
+}
+
+void XmlLoader::setMaxAge(int seconds)
+{
+    m_maxAge = seconds;
+}
+
+void XmlLoader::setStreaming(bool streaming)
+{
+    m_streaming = streaming;
+}
+
+void XmlLoader::setCacheable(bool cacheable)
+{
+    m_cacheable = cacheable;
+}
+
+QString XmlLoader::cacheFileName(const QUrl &url)
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QLatin1String("/knewstuff3/xml/");
+    return dir + QString::fromLatin1(QCryptographicHash::hash(url.toEncoded(), QCryptographicHash::Sha1).toHex());
+}
+
+bool XmlLoader::readCacheInfo(const QString &fileName, CacheInfo &info)
+{
+    QFile file(fileName + QLatin1String(".info"));
+    if (!file.open(QIODevice::ReadOnly) || !QFile::exists(fileName + QLatin1String(".xml"))) {
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_5);
+    quint32 magic;
+    quint32 version;
+    qint32 serverMaxAge;
+    stream >> magic >> version;
+    if (magic != CacheInfoMagic || version != CacheInfoVersion) {
+        return false;
+    }
+    stream >> info.etag >> info.lastModified >> info.fetchedAt >> serverMaxAge;
+    info.serverMaxAge = serverMaxAge;
+    return stream.status() == QDataStream::Ok && info.fetchedAt.isValid();
+}
+
+void XmlLoader::writeCacheInfo(const QString &fileName, const CacheInfo &info)
+{
+    QSaveFile file(fileName + QLatin1String(".info"));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_5);
+    stream << CacheInfoMagic << CacheInfoVersion
+           << info.etag << info.lastModified << info.fetchedAt << qint32(info.serverMaxAge);
+    file.commit();
+}
+
 void XmlLoader::load(const QUrl &url)
 {
     m_jobdata.clear();
+    m_url = url;
+    m_cacheFile.clear();
+    m_cacheInfo = CacheInfo();
+    m_haveCache = false;
+    m_loadingFromCache = false;
+    m_cacheWriter.reset();
+    resetDecoding();
+
+    m_aborted = false;
+    delete m_parser;
+    m_parser = 0;
+    if (m_streaming) {
+        m_parser = new FeedParser(this);
+        connect(m_parser, &FeedParser::entriesParsed, this, &XmlLoader::signalEntriesLoaded);
+        connect(m_parser, &FeedParser::parsingFinished, this, &XmlLoader::slotParsingFinished);
+        connect(m_parser, &FeedParser::parsingFailed, this, &XmlLoader::slotParsingFailed);
+    }
 
     qCDebug(KNEWSTUFF) << "XmlLoader::load(): url: " << url;
 
+    // only http answers carry the validators needed to revalidate a cached copy
+    if (m_cacheable && (url.scheme() == QLatin1String("http") || url.scheme() == QLatin1String("https"))) {
+        m_cacheFile = cacheFileName(url);
+        m_haveCache = readCacheInfo(m_cacheFile, m_cacheInfo);
+    }
+
+    if (m_haveCache) {
+        const qint64 age = m_cacheInfo.fetchedAt.secsTo(QDateTime::currentDateTimeUtc());
+        if (age >= 0 && age < qMax(m_maxAge, m_cacheInfo.serverMaxAge)) {
+            qCDebug(KNEWSTUFF) << "Using cached copy of" << url << "fetched" << age << "seconds ago";
+            // callers connect after calling load, answer from the event loop
+            m_loadingFromCache = true;
+            QTimer::singleShot(0, this, SLOT(loadFromCache()));
+            return;
+        }
+    }
+
     KIO::TransferJob *job = KIO::get(url, KIO::Reload, KIO::HideProgressInfo);
+    if (!m_cacheFile.isEmpty()) {
+        job->addMetaData(QStringLiteral("PropagateHttpHeader"), QStringLiteral("true"));
+        // whether the copy is kept is only known from the headers once the job is done
+        QDir().mkpath(QFileInfo(m_cacheFile).absolutePath());
+        m_cacheWriter.reset(new QSaveFile(m_cacheFile + QLatin1String(".xml")));
+        if (!m_cacheWriter->open(QIODevice::WriteOnly)) {
+            m_cacheWriter.reset();
+        }
+    }
+    if (m_haveCache) {
+        QStringList conditions;
+        if (!m_cacheInfo.etag.isEmpty()) {
+            conditions << QStringLiteral("If-None-Match: ") + m_cacheInfo.etag;
+        }
+        if (!m_cacheInfo.lastModified.isEmpty()) {
+            conditions << QStringLiteral("If-Modified-Since: ") + m_cacheInfo.lastModified;
+        }
+        if (!conditions.isEmpty()) {
+            job->addMetaData(QStringLiteral("customHTTPHeader"), conditions.join(QStringLiteral("\r\n")));
+        }
+    }
     connect(job, &KJob::result,
             this, &XmlLoader::slotJobResult);
     connect(job, &KIO::TransferJob::data,
             this, &XmlLoader::slotJobData);
+    m_job = job;
 
     emit jobStarted(job);
 }
 
-void XmlLoader::slotJobData(KIO::Job *, const QByteArray &data)
+void XmlLoader::abort()
+{
+    if (m_job) {
+        m_job->kill();
+        m_job = 0;
+    }
+    m_loadingFromCache = false;
+    m_aborted = true;
+    m_jobdata.clear();
+    m_cacheWriter.reset();
+    resetDecoding();
+    if (m_parser) {
+        m_parser->abort();
+    }
+}
+
+void XmlLoader::resetDecoding()
+{
+    if (m_filter) {
+        m_filter->terminate();
+        m_filter.reset();
+    }
+    m_header.clear();
+    m_formatKnown = false;
+    m_filterFinished = false;
+    m_decodeFailed = false;
+}
+
+void XmlLoader::startDecoding()
+{
+    m_formatKnown = true;
+
+    KCompressionDevice::CompressionType type = KCompressionDevice::None;
+    if (m_header.startsWith("\x1f\x8b")) {
+        type = KCompressionDevice::GZip;
+    } else if (m_header.startsWith("BZh")) {
+        type = KCompressionDevice::BZip2;
+    } else if (m_header.startsWith(QByteArray("\xfd" "7zXZ\x00", 6))) {
+        type = KCompressionDevice::Xz;
+    } else if (m_header.startsWith("\x28\xb5\x2f\xfd")) {
+#if KARCHIVE_VERSION >= QT_VERSION_CHECK(5, 82, 0)
+        type = KCompressionDevice::Zstd;
+#else
+        qWarning() << "Cannot decompress zstd document" << m_url << "- KArchive is too old";
+        m_decodeFailed = true;
+#endif
+    }
+
+    const QByteArray header = m_header;
+    m_header.clear();
+    if (type != KCompressionDevice::None) {
+        qCDebug(KNEWSTUFF) << "Decompressing" << m_url << "compression type" << type;
+        m_filter.reset(KCompressionDevice::filterForCompressionType(type));
+        if (!m_filter || !m_filter->init(QIODevice::ReadOnly)) {
+            m_decodeFailed = true;
+            return;
+        }
+        m_filter->setInBuffer(header.constData(), header.size());
+        if (!m_filter->readHeader()) {
+            m_decodeFailed = true;
+            return;
+        }
+    }
+    decode(header);
+}
+
+bool XmlLoader::decode(const QByteArray &data)
+{
+    if (m_decodeFailed) {
+        return false;
+    }
+    if (!m_filter) {
+        consume(data.constData(), data.size());
+        return true;
+    }
+    if (m_filterFinished) {
+        // trailing garbage after the compressed stream is ignored
+        return true;
+    }
+
+    char buffer[8192];
+    if (!m_filter->inBufferEmpty()) {
+        // left over from readHeader(), it points into the header that was passed in
+        Q_ASSERT(data.size() >= m_filter->inBufferAvailable());
+        const int offset = data.size() - m_filter->inBufferAvailable();
+        m_filter->setInBuffer(data.constData() + offset, data.size() - offset);
+    } else {
+        m_filter->setInBuffer(data.constData(), data.size());
+    }
+    forever {
+        m_filter->setOutBuffer(buffer, sizeof(buffer));
+        const KFilterBase::Result result = m_filter->uncompress();
+        consume(buffer, sizeof(buffer) - m_filter->outBufferAvailable());
+        if (result == KFilterBase::Error) {
+            qWarning() << "Cannot decompress" << m_url;
+            m_decodeFailed = true;
+            return false;
+        }
+        if (result == KFilterBase::End) {
+            m_filterFinished = true;
+            return true;
+        }
+        if (m_filter->inBufferEmpty() && m_filter->outBufferAvailable() > 0) {
+            // everything that arrived so far is decompressed
+            return true;
+        }
+    }
+}
+
+void XmlLoader::loadFromCache()
+{
+    if (!m_loadingFromCache) {
+        // aborted
+        return;
+    }
+    m_loadingFromCache = false;
+
+    if (!consumeCacheFile()) {
+        if (!m_aborted) {
+            emit signalFailed();
+        }
+        return;
+    }
+    finish();
+}
+
+bool XmlLoader::consumeCacheFile()
 {
-    qCDebug(KNEWSTUFF) << "XmlLoader::slotJobData()";
+    QFile file(m_cacheFile + QLatin1String(".xml"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    while (!file.atEnd()) {
+        const QByteArray chunk = file.read(CacheChunkSize);
+        if (chunk.isEmpty()) {
+            return false;
+        }
+        consume(chunk.constData(), chunk.size());
+        if (m_aborted) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    m_jobdata.append(data);
+void XmlLoader::consume(const char *data, int size)
+{
+    if (size <= 0) {
+        return;
+    }
+    if (m_cacheWriter) {
+        m_cacheWriter->write(data, size);
+    }
+    if (m_parser) {
+        m_parser->addData(QByteArray(data, size));
+    } else {
+        m_jobdata.append(data, size);
+    }
+}
+
+void XmlLoader::slotJobData(KIO::Job *, const QByteArray &data)
+{
+    if (m_formatKnown) {
+        decode(data);
+    } else {
+        m_header.append(data);
+        if (m_header.size() >= SniffSize) {
+            startDecoding();
+        }
+    }
 }
 
 void XmlLoader::slotJobResult(KJob *job)
 {
+    m_job = 0;
+
+    KIO::TransferJob *transferJob = qobject_cast<KIO::TransferJob *>(job);
+    const int responseCode = transferJob ? transferJob->queryMetaData(QStringLiteral("responsecode")).toInt() : 0;
+
+    if (responseCode == 304 && m_haveCache) {
+        qCDebug(KNEWSTUFF) << m_url << "not modified, using cached copy";
+        m_cacheWriter.reset();
+        resetDecoding();
+        if (!consumeCacheFile()) {
+            if (!m_aborted) {
+                emit signalFailed();
+            }
+            return;
+        }
+        m_cacheInfo.fetchedAt = QDateTime::currentDateTimeUtc();
+        writeCacheInfo(m_cacheFile, m_cacheInfo);
+        finish();
+        return;
+    }
+
     if (job->error()) {
+        m_cacheWriter.reset();
         emit signalFailed();
         return;
     }
-    qCDebug(KNEWSTUFF) << "--Xml Loader-START--";
-    qCDebug(KNEWSTUFF) << QString::fromUtf8(m_jobdata);
-    qCDebug(KNEWSTUFF) << "--Xml Loader-END--";
-    QDomDocument doc;
-    if (!doc.setContent(m_jobdata)) {
+
+    if (!m_formatKnown) {
+        // short document
+        startDecoding();
+        if (m_aborted) {
+            return;
+        }
+    }
+    if (m_decodeFailed || (m_filter && !m_filterFinished)) {
+        qWarning() << "Compressed document" << m_url << "is damaged or incomplete";
+        m_cacheWriter.reset();
+        resetDecoding();
         emit signalFailed();
         return;
     }
+    resetDecoding();
+
+    if (transferJob && m_cacheWriter && responseCode == 200) {
+        storeInCache(transferJob->queryMetaData(QStringLiteral("HTTP-Headers")));
+    }
+    m_cacheWriter.reset();
+    finish();
+}
+
+void XmlLoader::storeInCache(const QString &headers)
+{
+    CacheInfo info;
+    info.fetchedAt = QDateTime::currentDateTimeUtc();
+    foreach (const QString &line, headers.split(QLatin1Char('\n'))) {
+        const int colon = line.indexOf(QLatin1Char(':'));
+        if (colon <= 0) {
+            continue;
+        }
+        const QString name = line.left(colon).trimmed().toLower();
+        const QString value = line.mid(colon + 1).trimmed();
+        if (name == QLatin1String("etag")) {
+            info.etag = value;
+        } else if (name == QLatin1String("last-modified")) {
+            info.lastModified = value;
+        } else if (name == QLatin1String("cache-control")) {
+            foreach (const QString &directive, value.split(QLatin1Char(','))) {
+                const QString d = directive.trimmed().toLower();
+                if (d == QLatin1String("no-store")) {
+                    m_cacheWriter.reset();
+                    return;
+                } else if (d.startsWith(QLatin1String("max-age="))) {
+                    info.serverMaxAge = qMax(0, d.mid(8).toInt());
+                } else if (d == QLatin1String("no-cache")) {
+                    info.serverMaxAge = 0;
+                    break;
+                }
+            }
+        }
+    }
+
+    // without validators or a max-age the cached copy could never be used
+    if (info.etag.isEmpty() && info.lastModified.isEmpty() && info.serverMaxAge == 0 && m_maxAge == 0) {
+        m_cacheWriter.reset();
+        return;
+    }
+
+    if (!m_cacheWriter->commit()) {
+        qCWarning(KNEWSTUFF) << "Cannot cache" << m_url << m_cacheWriter->errorString();
+        return;
+    }
+    writeCacheInfo(m_cacheFile, info);
+    pruneCache(QFileInfo(m_cacheFile).absolutePath());
+}
+
+void XmlLoader::pruneCache(const QString &directory)
+{
+    // the info file of a document is written whenever it is fetched or revalidated, most recent first
+    const QFileInfoList infoFiles = QDir(directory).entryInfoList(QStringList(QStringLiteral("*.info")), QDir::Files, QDir::Time);
+    const QDateTime oldest = QDateTime::currentDateTime().addDays(-MaximumCacheAge);
+    qint64 total = 0;
+    foreach (const QFileInfo &infoFile, infoFiles) {
+        const QString document = infoFile.absolutePath() + QLatin1Char('/') + infoFile.completeBaseName() + QLatin1String(".xml");
+        const qint64 size = infoFile.size() + QFileInfo(document).size();
+        if (infoFile.lastModified() < oldest || total + size > MaximumCacheSize) {
+            qCDebug(KNEWSTUFF) << "Removing cached document" << document;
+            QFile::remove(document);
+            QFile::remove(infoFile.absoluteFilePath());
+            continue;
+        }
+        total += size;
+    }
+
+    // documents whose info file is gone cannot be used anymore
+    foreach (const QFileInfo &document, QDir(directory).entryInfoList(QStringList(QStringLiteral("*.xml")), QDir::Files)) {
+        if (!QFile::exists(document.absolutePath() + QLatin1Char('/') + document.completeBaseName() + QLatin1String(".info"))) {
+            qCDebug(KNEWSTUFF) << "Removing orphaned cached document" << document.absoluteFilePath();
+            QFile::remove(document.absoluteFilePath());
+        }
+    }
+}
+
+void XmlLoader::finish()
+{
+    if (m_parser) {
+        // signalLoaded() follows once the last entries are parsed
+        m_parser->finish();
+        return;
+    }
+
+    qCDebug(KNEWSTUFF) << "Loaded" << m_jobdata.size() << "bytes from" << m_url;
+    QDomDocument doc;
+    const bool valid = doc.setContent(m_jobdata);
+    m_jobdata.clear();
+    if (!valid) {
+        failed();
+        return;
+    }
     emit signalLoaded(doc);
 }
 
+void XmlLoader::slotParsingFinished()
+{
+    emit signalLoaded(m_parser->documentSkeleton());
+}
+
+void XmlLoader::slotParsingFailed()
+{
+    qCDebug(KNEWSTUFF) << "Cannot parse" << m_url;
+    if (m_job) {
+        m_job->kill();
+        m_job = 0;
+    }
+    m_cacheWriter.reset();
+    resetDecoding();
+    failed();
+}
+
+void XmlLoader::failed()
+{
+    if (!m_cacheFile.isEmpty()) {
+        // do not serve a broken document again
+        QFile::remove(m_cacheFile + QLatin1String(".info"));
+        QFile::remove(m_cacheFile + QLatin1String(".xml"));
+    }
+    emit signalFailed();
+}
+
 QDomElement addElement(QDomDocument &doc, QDomElement &parent,
                        const QString &tag, const QString &value)
 {
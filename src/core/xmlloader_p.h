@@ -22,10 +22,17 @@
 #define KNEWSTUFF3_XMLLOADER_P_H
 
 #include <QtXml/qdom.h>
+#include <QtCore/QDateTime>
 #include <QtCore/QObject>
+#include <QtCore/QScopedPointer>
 #include <QtCore/QString>
 #include <QUrl>
 
+#include "entryinternal_p.h"
+
+class QSaveFile;
+
+class KFilterBase;
 class KJob;
 
 namespace KIO
@@ -35,6 +42,7 @@ class Job;
 
 namespace KNS3
 {
+class FeedParser;
 
 QDomElement addElement(QDomDocument &doc, QDomElement &parent,
                        const QString &tag, const QString &value);
@@ -45,6 +53,19 @@ QDomElement addElement(QDomDocument &doc, QDomElement &parent,
  * resulting domdocument once completed.
  * It should probably not be used directly by the application.
  *
+ * Documents loaded over http are kept in a cache on disk. Later loads ask the
+ * server whether the document changed (using its ETag and Last-Modified date)
+ * and use the cached copy if it did not. Documents that have not been fetched
+ * for a month are removed from the cache, and so are the least recently fetched
+ * ones when the cache grows too large.
+ *
+ * Compressed documents (gzip, bzip2, xz and, with a recent KArchive, zstd) are
+ * recognized by their magic bytes and decompressed while they are downloaded.
+ *
+ * In streaming mode the children of the document element are turned into entries
+ * on worker threads while the document arrives, without building the whole
+ * document in memory.
+ *
  * @internal
  */
 class XmlLoader : public QObject
@@ -55,6 +76,7 @@ public:
      * Constructor.
      */
     explicit XmlLoader(QObject *parent);
+    ~XmlLoader();
 
     /**
      * Starts asynchronously loading the xml document from the
@@ -64,12 +86,50 @@ public:
      */
     void load(const QUrl &url);
 
+    /**
+     * The URL given to load(), relative links in the document are relative to it.
+     */
+    QUrl url() const;
+
+    /**
+     * Use a cached document without asking the server if it is younger than @p seconds.
+     * The server can allow longer with a Cache-Control max-age.
+     * Defaults to 0, every load is at least revalidated.
+     */
+    void setMaxAge(int seconds);
+
+    /**
+     * Parse the document into entries while it is downloaded. The entries are emitted
+     * in batches with signalEntriesLoaded(), signalLoaded() gets a document with only
+     * the document element and its attributes.
+     * Has to be called before load().
+     */
+    void setStreaming(bool streaming);
+
+    /**
+     * Whether the document is kept in the cache on disk (the default). Documents that
+     * are different every time they are asked for, like changes since a given version,
+     * should not be.
+     * Has to be called before load().
+     */
+    void setCacheable(bool cacheable);
+
+    /**
+     * Stops loading, neither signalLoaded() nor signalFailed() will be emitted.
+     */
+    void abort();
+
 Q_SIGNALS:
     /**
      * Indicates that the list of providers has been successfully loaded.
      */
     void signalLoaded(const QDomDocument &);
     void signalFailed();
+    /**
+     * Entries parsed from the data received so far, in document order.
+     * Only emitted in streaming mode.
+     */
+    void signalEntriesLoaded(const KNS3::EntryInternal::List &);
 
     void jobStarted(KJob *);
 
@@ -77,8 +137,64 @@ protected Q_SLOTS:
     void slotJobData(KIO::Job *, const QByteArray &);
     void slotJobResult(KJob *);
 
+private Q_SLOTS:
+    void loadFromCache();
+    void slotParsingFinished();
+    void slotParsingFailed();
+
 private:
+    // validators and age of the cached copy of a document
+    struct CacheInfo {
+        CacheInfo() : serverMaxAge(0) {}
+        QString etag;
+        QString lastModified;
+        QDateTime fetchedAt;
+        int serverMaxAge;
+    };
+    static QString cacheFileName(const QUrl &url);
+    static bool readCacheInfo(const QString &fileName, CacheInfo &info);
+    static void writeCacheInfo(const QString &fileName, const CacheInfo &info);
+    void storeInCache(const QString &headers);
+    // remove old documents and documents without info from the cache directory until it is within its limits
+    static void pruneCache(const QString &directory);
+    // the data read from the cache file instead of the network
+    bool consumeCacheFile();
+    // decompressed data of the document
+    void consume(const char *data, int size);
+    void finish();
+    void failed();
+    // pick a decompression filter from the first bytes of the document
+    void startDecoding();
+    bool decode(const QByteArray &data);
+    void resetDecoding();
+
+    // the document (not used in streaming mode)
     QByteArray m_jobdata;
+    KJob *m_job;
+    QUrl m_url;
+    int m_maxAge;
+    bool m_cacheable;
+    // the cache file of the document being loaded, empty if it is not cached
+    QString m_cacheFile;
+    CacheInfo m_cacheInfo;
+    bool m_haveCache;
+    // a fresh cached copy is about to be used
+    bool m_loadingFromCache;
+    // the first bytes of the document, until the compression is known
+    QByteArray m_header;
+    bool m_formatKnown;
+    // decompresses the document as it arrives, null for plain documents
+    QScopedPointer<KFilterBase> m_filter;
+    bool m_filterFinished;
+    bool m_decodeFailed;
+    // writes the document to the cache while it is downloaded
+    QScopedPointer<QSaveFile> m_cacheWriter;
+
+    bool m_streaming;
+    // parses the document in streaming mode
+    FeedParser *m_parser;
+    // abort() was called, possibly by a receiver of signalEntriesLoaded()
+    bool m_aborted;
 };
 
 }
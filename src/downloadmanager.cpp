@@ -83,7 +83,9 @@ void DownloadManagerPrivate::init(const QString &configFile)
 {
     q->connect(engine, SIGNAL(signalProvidersLoaded()), q, SLOT(_k_slotProvidersLoaded()));
     q->connect(engine, SIGNAL(signalUpdateableEntriesLoaded(KNS3::EntryInternal::List)), q, SLOT(_k_slotEntriesLoaded(KNS3::EntryInternal::List)));
-    q->connect(engine, SIGNAL(signalEntriesLoaded(KNS3::EntryInternal::List)), q, SLOT(_k_slotEntriesLoaded(KNS3::EntryInternal::List)));
+    q->connect(engine, SIGNAL(signalUpdateCheckFinished()), q, SIGNAL(updateCheckFinished()));
+    // one search result per page, not the entries the engine shows ahead of it
+    q->connect(engine, SIGNAL(signalPageLoaded(KNS3::EntryInternal::List)), q, SLOT(_k_slotEntriesLoaded(KNS3::EntryInternal::List)));
     q->connect(engine, SIGNAL(signalEntryChanged(KNS3::EntryInternal)), q, SLOT(_k_slotEntryStatusChanged(KNS3::EntryInternal)));
     q->connect(engine, SIGNAL(signalError(QString)), q, SLOT(_k_slotEngineError(QString)));
     engine->init(configFile);
@@ -193,6 +195,11 @@ void DownloadManager::setSearchOrder(DownloadManager::SortOrder order)
     }
 }
 
+void DownloadManager::setInteractive(bool interactive)
+{
+    d->engine->setInteractive(interactive);
+}
+
 void DownloadManager::setSearchTerm(const QString &searchTerm)
 {
     d->engine->setSearchTerm(searchTerm);
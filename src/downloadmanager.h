@@ -72,7 +72,8 @@ public:
 
     /**
       Check for available updates.
-      Use searchResult to get notified as soon as an update has been found.
+      Use searchResult to get notified as soon as an update has been found,
+      updateCheckFinished is emitted once all providers have been checked.
       */
     void checkForUpdates();
 
@@ -112,6 +113,17 @@ public:
       */
     void setSearchOrder(SortOrder order);
 
+    /**
+      Whether installing may ask the user questions, for example before overwriting
+      an existing file. This is the default.
+      Without interaction existing files are overwritten, downloads that turn out
+      to be web pages instead of the actual content fail and so do items that
+      have to be bought.
+
+      @since 5.28
+      */
+    void setInteractive(bool interactive);
+
 Q_SIGNALS:
     /**
       Returns the search result.
@@ -120,6 +132,14 @@ Q_SIGNALS:
      */
     void searchResult(const KNS3::Entry::List &entries);
 
+    /**
+      All providers answered checkForUpdates(), there are no more searchResult
+      signals for it.
+
+      @since 5.28
+     */
+    void updateCheckFinished();
+
     /**
       The entry status has changed: emitted when the entry has been installed, updated or removed.
       Use KNS3::Entry::status() to check the current status.
@@ -236,10 +236,13 @@ void DownloadWidgetPrivate::init(const QString &configFile)
     q->connect(engine, SIGNAL(signalEntryChanged(KNS3::EntryInternal)), q, SLOT(slotEntryChanged(KNS3::EntryInternal)));
 
     q->connect(engine, &Engine::signalResetView, model, &ItemsModel::clearEntries);
+    q->connect(engine, &Engine::signalEntryRemoved, model, &ItemsModel::removeEntry);
     q->connect(engine, &Engine::signalEntryPreviewLoaded,
                model, &ItemsModel::slotEntryPreviewLoaded);
 
     engine->init(configFile);
+    // show what was found in the last session until the providers are loaded
+    engine->reloadEntries();
 
     delegate = new ItemsViewDelegate(ui.m_listView, engine, q);
     ui.m_listView->setItemDelegate(delegate);
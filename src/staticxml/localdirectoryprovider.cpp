@@ -0,0 +1,53 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "localdirectoryprovider_p.h"
+
+#include <knewstuff_debug.h>
+
+#include <QtCore/QDir>
+
+using namespace KNS3;
+
+LocalDirectoryProvider::LocalDirectoryProvider()
+{
+}
+
+bool LocalDirectoryProvider::setProviderXML(const QDomElement &xmldata)
+{
+    if (xmldata.tagName() != QLatin1String("provider")) {
+        return false;
+    }
+
+    const QString path = xmldata.attribute(QStringLiteral("path"));
+    const QUrl url = path.startsWith(QLatin1String("file:")) ? QUrl(path) : QUrl::fromLocalFile(path);
+    if (path.isEmpty() || !url.isLocalFile()) {
+        qWarning() << "LocalDirectoryProvider: no local path given";
+        return false;
+    }
+    const QString index = xmldata.attribute(QStringLiteral("index"), QStringLiteral("index.knsfeed"));
+    const QString directory = QDir::cleanPath(url.toLocalFile());
+    qCDebug(KNEWSTUFF) << "Local directory provider for" << directory;
+
+    // the index is the generic feed of a static provider
+    QDomElement provider = xmldata.cloneNode().toElement();
+    provider.setAttribute(QStringLiteral("downloadurl"), QUrl::fromLocalFile(directory + QLatin1Char('/') + index).toString());
+    if (!provider.hasAttribute(QStringLiteral("uploadurl")) && !provider.hasAttribute(QStringLiteral("nouploadurl"))) {
+        provider.setAttribute(QStringLiteral("nouploadurl"), QUrl::fromLocalFile(directory).toString());
+    }
+    return StaticXmlProvider::setProviderXML(provider);
+}
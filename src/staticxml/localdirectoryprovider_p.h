@@ -0,0 +1,52 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef KNEWSTUFF3_LOCALDIRECTORYPROVIDER_P_H
+#define KNEWSTUFF3_LOCALDIRECTORYPROVIDER_P_H
+
+#include "staticxmlprovider_p.h"
+
+namespace KNS3
+{
+
+/**
+ * @short Provider for a local or mounted directory of payloads.
+ *
+ * The entries are read from an index file in the directory (by default
+ * index.knsfeed, as written by knewstuff-indexdir), payloads and previews are
+ * given relative to it. Installing an entry links or copies the payload from
+ * the directory, nothing is downloaded.
+ *
+ * Provider element: <provider type="directory" path="/srv/mirror/wallpapers" index="index.knsfeed">
+ *
+ * @internal
+ */
+class LocalDirectoryProvider: public StaticXmlProvider
+{
+    Q_OBJECT
+public:
+    LocalDirectoryProvider();
+
+    bool setProviderXML(const QDomElement &xmldata) Q_DECL_OVERRIDE;
+
+private:
+    Q_DISABLE_COPY(LocalDirectoryProvider)
+};
+
+}
+
+#endif
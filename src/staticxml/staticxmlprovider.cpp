@@ -21,22 +21,38 @@
 
 #include "staticxmlprovider_p.h"
 
+#include "core/resultmerger_p.h"
 #include "core/xmlloader_p.h"
 
 #include <knewstuff_debug.h>
 #include <klocalizedstring.h>
 
 #include <QtCore/QTimer>
+#include <QtCore/QUrlQuery>
+
+#include <algorithm>
+#include <climits>
 
 
 namespace KNS3
 {
 
+// how long (s) requests are answered from a loaded catalog before it is loaded again
+static const int CatalogLifetime = 300;
+
 StaticXmlProvider::StaticXmlProvider()
-    : mInitialized(false)
+    : mDeltaLoader(0)
+    , mUpdateManifestLoader(0)
+    , mInitialized(false)
+    , mFeedMaxAge(0)
 {
 }
 
+void StaticXmlProvider::setFeedMaxAge(int seconds)
+{
+    mFeedMaxAge = seconds;
+}
+
 QString StaticXmlProvider::id() const
 {
     return mId;
@@ -73,6 +89,9 @@ bool StaticXmlProvider::setProviderXML(const QDomElement &xmldata)
         mDownloadUrls.insert(QStringLiteral("downloads"), QUrl(url));
     }
 
+    mUpdateManifestUrl = QUrl(xmldata.attribute(QStringLiteral("downloadurl-updates")));
+    mDeltaUrlTemplate = xmldata.attribute(QStringLiteral("downloadurl-delta"));
+
     // FIXME: this depends on freedesktop.org icon naming... introduce 'desktopicon'?
     QUrl iconurl(xmldata.attribute(QStringLiteral("icon")));
     if (!iconurl.isValid()) {
@@ -125,137 +144,633 @@ bool StaticXmlProvider::isInitialized() const
 void StaticXmlProvider::setCachedEntries(const KNS3::EntryInternal::List &cachedEntries)
 {
     qCDebug(KNEWSTUFF) << "Set cached entries " << cachedEntries.size();
-    mCachedEntries.append(cachedEntries);
+    mCachedEntries.insert(cachedEntries);
+    foreach (const EntryInternal &entry, cachedEntries) {
+        mSearchIndex.insert(entry);
+    }
 }
 
 void StaticXmlProvider::loadEntries(const KNS3::Provider::SearchRequest &request)
 {
-    mCurrentRequest = request;
+    if (request.sortMode == Installed) {
+        qCDebug(KNEWSTUFF) << "Installed entries: " << mId << installedEntries().size();
+        emit loadingFinished(request, installedEntries());
+        return;
+    }
 
-    // static providers only have on page containing everything
-    if (request.page > 0) {
-        emit loadingFinished(request, EntryInternal::List());
+    if (request.sortMode == Updates) {
+        if (mUpdateManifestUrl.isValid()) {
+            // look at the manifest first, the full feed is only needed if something changed
+            mUpdateRequests.append(request);
+            if (!mUpdateManifestLoader) {
+                mUpdateManifestLoader = new XmlLoader(this);
+                connect(mUpdateManifestLoader, &XmlLoader::signalLoaded, this, &StaticXmlProvider::slotUpdateManifestLoaded);
+                connect(mUpdateManifestLoader, &XmlLoader::signalFailed, this, &StaticXmlProvider::slotUpdateManifestFailed);
+                // asked for on every update check, a cached copy would only be revalidated
+                mUpdateManifestLoader->setCacheable(false);
+                mUpdateManifestLoader->load(mUpdateManifestUrl);
+            }
+        } else {
+            // update checks always look at the current catalog
+            refreshCatalog(request);
+        }
         return;
     }
 
-    if (request.sortMode == Installed) {
-        qCDebug(KNEWSTUFF) << "Installed entries: " << mId << installedEntries().size();
-        emit loadingFinished(request, installedEntries());
+    // later pages continue the result set of the catalog that answered the first one
+    const bool catalogFresh = mCatalogAge.isValid()
+                              && (request.page > 0 || mCatalogAge.elapsed() < qMax(mFeedMaxAge, CatalogLifetime) * qint64(1000));
+    if (!catalogFresh) {
+        refreshCatalog(request);
         return;
     }
 
-    QUrl url = downloadUrl(request.sortMode);
-    if (!url.isEmpty()) {
-        // TODO first get the entries, then filter with searchString, finally emit the finished signal...
-        // FIXME: don't creat an endless number of xmlloaders!
-        XmlLoader *loader = new XmlLoader(this);
-        connect(loader, &XmlLoader::signalLoaded, this, &StaticXmlProvider::slotFeedFileLoaded);
-        connect(loader, &XmlLoader::signalFailed, this, &StaticXmlProvider::slotFeedFailed);
+    const QUrl orderUrl = sortFeedUrl(request.sortMode);
+    if (!hasSortData(request.sortMode) && !orderUrl.isEmpty()) {
+        // the catalog cannot be sorted this way, the feed sorted by the server can
+        loadFeed(request, orderUrl);
+        return;
+    }
 
-        mFeedLoaders.insert(request.sortMode, loader);
+    answerRequest(request);
+}
 
-        loader->load(url);
+void StaticXmlProvider::loadFeed(const KNS3::Provider::SearchRequest &request, const QUrl &url)
+{
+    if (!url.isEmpty()) {
+        // all requests for the same feed share one loader
+        XmlLoader *loader = mFeedLoadersByUrl.value(url);
+        if (!loader) {
+            loader = new XmlLoader(this);
+            connect(loader, &XmlLoader::signalEntriesLoaded, this, &StaticXmlProvider::slotFeedEntriesLoaded);
+            connect(loader, &XmlLoader::signalLoaded, this, &StaticXmlProvider::slotFeedFileLoaded);
+            connect(loader, &XmlLoader::signalFailed, this, &StaticXmlProvider::slotFeedFailed);
+            mFeedLoadersByUrl.insert(url, loader);
+            // feeds can be large, they are parsed on worker threads while they download
+            loader->setStreaming(true);
+            loader->setMaxAge(mFeedMaxAge);
+            loader->load(url);
+        }
+        mFeedLoaders[loader].append(request);
     } else {
         emit loadingFailed(request);
     }
 }
 
-QUrl StaticXmlProvider::downloadUrl(SortMode mode) const
+void StaticXmlProvider::refreshCatalog(const KNS3::Provider::SearchRequest &request)
+{
+    // without a delta feed the catalog is loaded again, the loader revalidates its cached copy
+    if (mDeltaUrlTemplate.isEmpty() || mGeneration.isEmpty() || !mCatalogAge.isValid()) {
+        loadFeed(request, catalogUrl());
+        return;
+    }
+
+    mDeltaRequests.append(request);
+    if (!mDeltaLoader) {
+        // delta feeds are small, they are parsed in one go
+        mDeltaLoader = new XmlLoader(this);
+        connect(mDeltaLoader, &XmlLoader::signalLoaded, this, &StaticXmlProvider::slotDeltaLoaded);
+        connect(mDeltaLoader, &XmlLoader::signalFailed, this, &StaticXmlProvider::slotDeltaFailed);
+        // every generation has its own delta url, each would be cached once and never used again
+        mDeltaLoader->setCacheable(false);
+        mDeltaLoader->load(deltaUrl());
+    }
+}
+
+QUrl StaticXmlProvider::deltaUrl() const
+{
+    QString url = mDeltaUrlTemplate;
+    if (url.contains(QLatin1String("{since}"))) {
+        return QUrl(url.replace(QLatin1String("{since}"), QString::fromLatin1(QUrl::toPercentEncoding(mGeneration))));
+    }
+
+    QUrl deltaUrl(url);
+    QUrlQuery query(deltaUrl);
+    query.removeAllQueryItems(QStringLiteral("since"));
+    query.addQueryItem(QStringLiteral("since"), QString::fromLatin1(QUrl::toPercentEncoding(mGeneration)));
+    deltaUrl.setQuery(query);
+    return deltaUrl;
+}
+
+void StaticXmlProvider::abortRequest(const KNS3::Provider::SearchRequest &request)
+{
+    mProgressSent.remove(request);
+    if (mUpdateRequests.removeAll(request) > 0 || mUpdateEntryRequests.removeAll(request) > 0) {
+        // the manifest and changed entries are small, they are loaded for later checks anyway
+        return;
+    }
+    if (mDeltaRequests.removeAll(request) > 0) {
+        if (mDeltaRequests.isEmpty()) {
+            mDeltaLoader->abort();
+            mDeltaLoader->deleteLater();
+            mDeltaLoader = 0;
+        }
+        return;
+    }
+    for (QHash<XmlLoader *, QList<Provider::SearchRequest> >::iterator it = mFeedLoaders.begin(); it != mFeedLoaders.end(); ++it) {
+        if (it->removeAll(request) == 0) {
+            continue;
+        }
+        if (it->isEmpty()) {
+            // nobody is interested in this feed anymore
+            XmlLoader *loader = it.key();
+            mFeedLoaders.erase(it);
+            mFeedLoadersByUrl.remove(mFeedLoadersByUrl.key(loader));
+            mFeedEntries.remove(loader);
+            loader->abort();
+            loader->deleteLater();
+        }
+        return;
+    }
+}
+
+QUrl StaticXmlProvider::catalogUrl() const
+{
+    // the generic feed has all entries, without it one of the sorted feeds has to do
+    QUrl url = mDownloadUrls.value(QString());
+    if (url.isEmpty() && !mDownloadUrls.isEmpty()) {
+        url = mDownloadUrls.constBegin().value();
+    }
+    return url;
+}
+
+QUrl StaticXmlProvider::sortFeedUrl(SortMode mode) const
 {
     QUrl url;
     switch (mode) {
-    case Installed: // should just query the registry and not end up here
     case Rating:
         url = mDownloadUrls.value(QStringLiteral("score"));
         break;
-    case Alphabetical:
-        url = mDownloadUrls.value(QString());
-        break;
-    case Updates:
     case Newest:
         url = mDownloadUrls.value(QStringLiteral("latest"));
         break;
     case Downloads:
         url = mDownloadUrls.value(QStringLiteral("downloads"));
         break;
+    default:
+        break;
     }
-    if (url.isEmpty()) {
-        url = mDownloadUrls.value(QString());
+    if (url == catalogUrl()) {
+        return QUrl();
     }
     return url;
 }
 
+bool StaticXmlProvider::hasSortData(SortMode mode) const
+{
+    if (mFeedOrder.contains(mode)) {
+        return true;
+    }
+    foreach (const EntryInternal &entry, mCatalog) {
+        switch (mode) {
+        case Rating:
+            if (entry.rating() != 0) {
+                return true;
+            }
+            break;
+        case Newest:
+            if (entry.releaseDate().isValid()) {
+                return true;
+            }
+            break;
+        case Downloads:
+            if (entry.downloadCount() != 0) {
+                return true;
+            }
+            break;
+        default:
+            return true;
+        }
+    }
+    // an empty catalog has nothing to sort
+    return mCatalog.isEmpty();
+}
+
+void StaticXmlProvider::answerRequest(const KNS3::Provider::SearchRequest &request)
+{
+    mProgressSent.remove(request);
+    EntryInternal::List entries = matchingEntries(request, mCatalog);
+    if (request.sortMode == Updates) {
+        emit loadingFinished(request, entries);
+        return;
+    }
+
+    const QHash<QString, int> order = mFeedOrder.value(request.sortMode);
+    if (!order.isEmpty()) {
+        // the order of the feed the server sorted, entries it does not have go last
+        std::stable_sort(entries.begin(), entries.end(), [&order](const EntryInternal &left, const EntryInternal &right) {
+            return order.value(left.uniqueId(), INT_MAX) < order.value(right.uniqueId(), INT_MAX);
+        });
+    } else {
+        const SortMode sortMode = request.sortMode;
+        std::stable_sort(entries.begin(), entries.end(), [sortMode](const EntryInternal &left, const EntryInternal &right) {
+            return ResultMerger::lessThan(sortMode, left, right);
+        });
+    }
+
+    if (request.pageSize > 0) {
+        entries = entries.mid(qMax(0, request.page) * request.pageSize, request.pageSize);
+    } else if (request.page > 0) {
+        entries.clear();
+    }
+    emit loadingFinished(request, entries);
+}
+
+EntryInternal StaticXmlProvider::feedEntry(EntryInternal entry, const QUrl &documentUrl)
+{
+    entry.setStatus(Entry::Downloadable);
+    entry.setProviderId(mId);
+    // payloads and previews can be given relative to the document they are listed in
+    const QUrl payload(entry.payload());
+    if (payload.isRelative() && !entry.payload().isEmpty()) {
+        entry.setPayload(documentUrl.resolved(payload).toString());
+    }
+    for (int i = 0; i < 6; ++i) {
+        const EntryInternal::PreviewType type = EntryInternal::PreviewType(i);
+        const QUrl preview(entry.previewUrl(type));
+        if (preview.isRelative() && !entry.previewUrl(type).isEmpty()) {
+            entry.setPreviewUrl(documentUrl.resolved(preview).toString(), type);
+        }
+    }
+    entry = mCachedEntries.merge(entry);
+    mSearchIndex.insert(entry);
+    return entry;
+}
+
+void StaticXmlProvider::slotFeedEntriesLoaded(const KNS3::EntryInternal::List &parsed)
+{
+    XmlLoader *loader = qobject_cast<KNS3::XmlLoader *>(sender());
+    if (!loader || !mFeedLoaders.contains(loader)) {
+        return;
+    }
+
+    EntryInternal::List batch;
+    foreach (const EntryInternal &entry, parsed) {
+        batch.append(feedEntry(entry, loader->url()));
+    }
+    mFeedEntries[loader].append(batch);
+
+    // show the first matches of a new search while the rest of the catalog loads, at most a page of them
+    foreach (const Provider::SearchRequest &request, mFeedLoaders.value(loader)) {
+        if (request.sortMode == Updates || request.page != 0) {
+            continue;
+        }
+        int &sent = mProgressSent[request];
+        EntryInternal::List entries = matchingEntries(request, batch).mid(0, qMax(0, request.pageSize - sent));
+        if (!entries.isEmpty()) {
+            sent += entries.size();
+            emit loadingProgress(request, entries);
+        }
+    }
+}
+
 void StaticXmlProvider::slotFeedFileLoaded(const QDomDocument &doc)
 {
     XmlLoader *loader = qobject_cast<KNS3::XmlLoader *>(sender());
-    if (!loader) {
+    if (!loader || !mFeedLoaders.contains(loader)) {
         qWarning() << "Loader not found!";
-        emit loadingFailed(mCurrentRequest);
         return;
     }
+    const QList<Provider::SearchRequest> requests = mFeedLoaders.take(loader);
+    const QUrl url = mFeedLoadersByUrl.key(loader);
+    mFeedLoadersByUrl.remove(url);
+    loader->deleteLater();
+
+    // the entries were parsed while the feed was loading, the document only has its root element
+    const EntryInternal::List feed = mFeedEntries.take(loader);
+
+    if (url == catalogUrl()) {
+        qCDebug(KNEWSTUFF) << "Loaded catalog of" << mId << "with" << feed.size() << "entries";
+        setCatalog(feed);
+        mCatalogAge.start();
+        mGeneration = doc.documentElement().attribute(QStringLiteral("generation"));
+        // sorted feeds are loaded again when needed, they may have changed as well
+        mFeedOrder.clear();
+    } else {
+        QHash<QString, int> order;
+        QSet<QString> known;
+        foreach (const EntryInternal &entry, mCatalog) {
+            known.insert(entry.uniqueId());
+        }
+        foreach (const EntryInternal &entry, feed) {
+            order.insert(entry.uniqueId(), order.size());
+            if (!known.contains(entry.uniqueId())) {
+                mCatalog.append(entry);
+            }
+        }
+        foreach (const QString &key, mDownloadUrls.keys()) {
+            if (mDownloadUrls.value(key) != url) {
+                continue;
+            }
+            if (key == QLatin1String("score")) {
+                mFeedOrder.insert(Rating, order);
+            } else if (key == QLatin1String("latest")) {
+                mFeedOrder.insert(Newest, order);
+            } else if (key == QLatin1String("downloads")) {
+                mFeedOrder.insert(Downloads, order);
+            }
+        }
+    }
+
+    continueRequests(requests);
+}
+
+void StaticXmlProvider::continueRequests(const QList<Provider::SearchRequest> &requests)
+{
+    foreach (const Provider::SearchRequest &request, requests) {
+        if (request.sortMode == Updates) {
+            answerRequest(request);
+        } else {
+            // the catalog is fresh now, this either answers the request or loads the sorted feed it needs
+            loadEntries(request);
+        }
+    }
+}
+
+void StaticXmlProvider::slotFeedFailed()
+{
+    XmlLoader *loader = qobject_cast<KNS3::XmlLoader *>(sender());
+    if (!loader || !mFeedLoaders.contains(loader)) {
+        return;
+    }
+    loader->deleteLater();
+    mFeedLoadersByUrl.remove(mFeedLoadersByUrl.key(loader));
+    mFeedEntries.remove(loader);
+    foreach (const Provider::SearchRequest &request, mFeedLoaders.take(loader)) {
+        mProgressSent.remove(request);
+        emit loadingFailed(request);
+    }
+}
 
-    // load all the entries from the domdocument given
-    EntryInternal::List entries;
-    QDomElement element;
+void StaticXmlProvider::slotDeltaLoaded(const QDomDocument &doc)
+{
+    const QUrl url = mDeltaLoader->url();
+    mDeltaLoader->deleteLater();
+    mDeltaLoader = 0;
+
+    const QDomElement root = doc.documentElement();
+    if (root.tagName() != QLatin1String("knewstuff-delta")) {
+        // the server cannot go back that far, the catalog is loaded like the first time: streamed and cached
+        qCDebug(KNEWSTUFF) << "No delta from" << mId << "loading the catalog instead";
+        mGeneration.clear();
+        const QList<Provider::SearchRequest> requests = mDeltaRequests;
+        mDeltaRequests.clear();
+        foreach (const Provider::SearchRequest &request, requests) {
+            loadFeed(request, catalogUrl());
+        }
+        return;
+    }
 
-    element = doc.documentElement();
-    QDomElement n;
-    for (n = element.firstChildElement(); !n.isNull(); n = n.nextSiblingElement()) {
+    // <knewstuff-delta generation="..."><stuff>...</stuff><removed id="..."/></knewstuff-delta>
+    QHash<QString, int> positions;
+    for (int i = 0; i < mCatalog.size(); ++i) {
+        positions.insert(mCatalog.at(i).uniqueId(), i);
+    }
+    QSet<QString> removed;
+    int changes = 0;
+    for (QDomElement e = root.firstChildElement(); !e.isNull(); e = e.nextSiblingElement(), ++changes) {
+        if (e.tagName() == QLatin1String("removed")) {
+            removed.insert(e.attribute(QStringLiteral("id")));
+            continue;
+        }
         EntryInternal entry;
-        entry.setEntryXML(n.toElement());
-        entry.setStatus(Entry::Downloadable);
-        entry.setProviderId(mId);
-
-        int index = mCachedEntries.indexOf(entry);
-        if (index >= 0) {
-
-            EntryInternal cacheEntry = mCachedEntries.takeAt(index);
-            // check if updateable
-            if ((cacheEntry.status() == Entry::Installed) &&
-                    ((cacheEntry.version() != entry.version()) || (cacheEntry.releaseDate() != entry.releaseDate()))) {
-                entry.setStatus(Entry::Updateable);
-                entry.setUpdateVersion(entry.version());
-                entry.setVersion(cacheEntry.version());
-                entry.setUpdateReleaseDate(entry.releaseDate());
-                entry.setReleaseDate(cacheEntry.releaseDate());
-            } else {
-                entry.setStatus(cacheEntry.status());
+        if (!entry.setEntryXML(e)) {
+            continue;
+        }
+        entry = feedEntry(entry, url);
+        removed.remove(entry.uniqueId());
+        QHash<QString, int>::const_iterator it = positions.constFind(entry.uniqueId());
+        if (it != positions.constEnd()) {
+            mCatalog[it.value()] = entry;
+        } else {
+            positions.insert(entry.uniqueId(), mCatalog.size());
+            mCatalog.append(entry);
+        }
+    }
+    if (!removed.isEmpty()) {
+        EntryInternal::List catalog;
+        foreach (const EntryInternal &entry, mCatalog) {
+            if (!removed.contains(entry.uniqueId())) {
+                catalog.append(entry);
             }
-            cacheEntry = entry;
         }
-        mCachedEntries.append(entry);
+        setCatalog(catalog);
+    }
+    qCDebug(KNEWSTUFF) << "Applied" << changes << "changes to the catalog of" << mId;
+    mGeneration = root.attribute(QStringLiteral("generation"));
+    mCatalogAge.start();
+    mFeedOrder.clear();
+
+    const QList<Provider::SearchRequest> requests = mDeltaRequests;
+    mDeltaRequests.clear();
+    continueRequests(requests);
+}
 
-        if (searchIncludesEntry(entry)) {
-            entries << entry;
+void StaticXmlProvider::setCatalog(const EntryInternal::List &catalog)
+{
+    QSet<QString> kept;
+    foreach (const EntryInternal &entry, catalog) {
+        kept.insert(entry.uniqueId());
+    }
+    foreach (const EntryInternal &entry, mCatalog) {
+        if (!kept.contains(entry.uniqueId())) {
+            // the store keeps it, installed entries are still known
+            mSearchIndex.remove(entry);
         }
     }
-    emit loadingFinished(mCurrentRequest, entries);
+    mCatalog = catalog;
 }
 
-void StaticXmlProvider::slotFeedFailed()
+void StaticXmlProvider::slotDeltaFailed()
 {
-    emit loadingFailed(mCurrentRequest);
+    qCDebug(KNEWSTUFF) << "Loading the delta feed failed, loading the catalog instead";
+    mDeltaLoader->deleteLater();
+    mDeltaLoader = 0;
+    mGeneration.clear();
+
+    const QList<Provider::SearchRequest> requests = mDeltaRequests;
+    mDeltaRequests.clear();
+    foreach (const Provider::SearchRequest &request, requests) {
+        loadFeed(request, catalogUrl());
+    }
 }
 
-bool StaticXmlProvider::searchIncludesEntry(const KNS3::EntryInternal &entry) const
+void StaticXmlProvider::slotUpdateManifestLoaded(const QDomDocument &doc)
 {
-    if (mCurrentRequest.sortMode == Updates) {
+    mUpdateManifestLoader->deleteLater();
+    mUpdateManifestLoader = 0;
+
+    // <updates><entry id="..." version="..." releasedate="yyyy-MM-dd" checksum="..." href="..."/></updates>
+    // href is optional, it points to the <stuff> element of the entry
+    QList<QUrl> changedEntryUrls;
+    bool canLoadChanges = true;
+    for (QDomElement e = doc.documentElement().firstChildElement(QStringLiteral("entry")); !e.isNull(); e = e.nextSiblingElement(QStringLiteral("entry"))) {
+        const EntryInternal known = mCachedEntries.entry(e.attribute(QStringLiteral("id")));
+        // a copy to compare with, the known entry shares its data with the store
+        EntryInternal compared;
+        compared.setChecksum(known.checksum());
+        if (known.status() == Entry::Updateable) {
+            // the update is known already, only a newer one has to be loaded
+            compared.setVersion(known.updateVersion());
+            compared.setReleaseDate(known.updateReleaseDate());
+        } else if (known.status() == Entry::Installed) {
+            compared.setVersion(known.version());
+            compared.setReleaseDate(known.releaseDate());
+        } else {
+            continue;
+        }
+
+        EntryInternal current;
+        current.setVersion(e.attribute(QStringLiteral("version")));
+        current.setReleaseDate(QDate::fromString(e.attribute(QStringLiteral("releasedate")), Qt::ISODate));
+        current.setChecksum(e.attribute(QStringLiteral("checksum")));
+        if (!EntryStore::isUpdate(compared, current)) {
+            continue;
+        }
+
+        qCDebug(KNEWSTUFF) << "Update available for" << known.name();
+        const QString href = e.attribute(QStringLiteral("href"));
+        if (href.isEmpty()) {
+            canLoadChanges = false;
+        } else {
+            changedEntryUrls.append(mUpdateManifestUrl.resolved(QUrl(href)));
+        }
+    }
+
+    const QList<Provider::SearchRequest> requests = mUpdateRequests;
+    mUpdateRequests.clear();
+    if (!canLoadChanges) {
+        // the manifest does not say where to find the changed entries, the catalog has them
+        foreach (const Provider::SearchRequest &request, requests) {
+            refreshCatalog(request);
+        }
+        return;
+    }
+
+    // only the entries that changed are loaded, nothing new means the known updates are the answer
+    mUpdateEntryRequests.append(requests);
+    foreach (const QUrl &url, changedEntryUrls) {
+        XmlLoader *loader = new XmlLoader(this);
+        connect(loader, &XmlLoader::signalLoaded, this, &StaticXmlProvider::slotUpdateEntryLoaded);
+        connect(loader, &XmlLoader::signalFailed, this, &StaticXmlProvider::slotUpdateEntryFailed);
+        loader->setCacheable(false);
+        mUpdateEntryLoaders.append(loader);
+        loader->load(url);
+    }
+    finishUpdateCheck();
+}
+
+void StaticXmlProvider::slotUpdateEntryLoaded(const QDomDocument &doc)
+{
+    XmlLoader *loader = qobject_cast<KNS3::XmlLoader *>(sender());
+    if (!loader || mUpdateEntryLoaders.removeAll(loader) == 0) {
+        return;
+    }
+    loader->deleteLater();
+
+    QDomElement e = doc.documentElement();
+    if (e.tagName() != QLatin1String("stuff")) {
+        e = e.firstChildElement(QStringLiteral("stuff"));
+    }
+    EntryInternal entry;
+    if (entry.setEntryXML(e)) {
+        entry = feedEntry(entry, loader->url());
+        // keep a loaded catalog in line with the entry
+        for (int i = 0; i < mCatalog.size(); ++i) {
+            if (mCatalog.at(i).uniqueId() == entry.uniqueId()) {
+                mCatalog[i] = entry;
+                break;
+            }
+        }
+    }
+    finishUpdateCheck();
+}
+
+void StaticXmlProvider::slotUpdateEntryFailed()
+{
+    XmlLoader *loader = qobject_cast<KNS3::XmlLoader *>(sender());
+    if (!loader || mUpdateEntryLoaders.removeAll(loader) == 0) {
+        return;
+    }
+    qCDebug(KNEWSTUFF) << "Loading a changed entry failed, checking the catalog instead";
+    loader->deleteLater();
+    foreach (XmlLoader *other, mUpdateEntryLoaders) {
+        other->abort();
+        other->deleteLater();
+    }
+    mUpdateEntryLoaders.clear();
+
+    const QList<Provider::SearchRequest> requests = mUpdateEntryRequests;
+    mUpdateEntryRequests.clear();
+    foreach (const Provider::SearchRequest &request, requests) {
+        refreshCatalog(request);
+    }
+}
+
+void StaticXmlProvider::finishUpdateCheck()
+{
+    if (!mUpdateEntryLoaders.isEmpty()) {
+        return;
+    }
+    const QList<Provider::SearchRequest> requests = mUpdateEntryRequests;
+    mUpdateEntryRequests.clear();
+    foreach (const Provider::SearchRequest &request, requests) {
+        emit loadingFinished(request, matchingEntries(request, mCachedEntries.entries()));
+    }
+}
+
+void StaticXmlProvider::slotUpdateManifestFailed()
+{
+    qCDebug(KNEWSTUFF) << "Loading the update manifest failed, checking the feed instead";
+    mUpdateManifestLoader->deleteLater();
+    mUpdateManifestLoader = 0;
+
+    const QList<Provider::SearchRequest> requests = mUpdateRequests;
+    mUpdateRequests.clear();
+    foreach (const Provider::SearchRequest &request, requests) {
+        loadFeed(request, catalogUrl());
+    }
+}
+
+bool StaticXmlProvider::searchIncludesEntry(const Provider::SearchRequest &request, const KNS3::EntryInternal &entry) const
+{
+    if (request.sortMode == Updates) {
         if (entry.status() != Entry::Updateable) {
             return false;
         }
     }
 
-    if (mCurrentRequest.searchTerm.isEmpty()) {
-        return true;
+    if (!request.categories.isEmpty() && !request.categories.contains(entry.category())) {
+        return false;
     }
-    QString search = mCurrentRequest.searchTerm;
-    if (entry.name().contains(search, Qt::CaseInsensitive) ||
-            entry.summary().contains(search, Qt::CaseInsensitive) ||
-            entry.author().name().contains(search, Qt::CaseInsensitive)
-       ) {
+
+    if (request.searchTerm.isEmpty()) {
         return true;
     }
-    return false;
+    return SearchIndex::matches(entry, request.searchTerm);
+}
+
+EntryInternal::List StaticXmlProvider::matchingEntries(const Provider::SearchRequest &request, const EntryInternal::List &entries) const
+{
+    EntryInternal::List result;
+    // short terms match too much for the index to help
+    if (request.searchTerm.size() < 3) {
+        foreach (const EntryInternal &entry, entries) {
+            if (searchIncludesEntry(request, entry)) {
+                result << entry;
+            }
+        }
+        return result;
+    }
+
+    // all entries are in the index, only look at those that contain the term
+    const QSet<EntryInternal> found = mSearchIndex.search(request.searchTerm);
+    foreach (const EntryInternal &entry, entries) {
+        if (found.contains(entry) && searchIncludesEntry(request, entry)) {
+            result << entry;
+        }
+    }
+    return result;
 }
 
 void StaticXmlProvider::loadPayloadLink(const KNS3::EntryInternal &entry, int)
@@ -267,7 +782,7 @@ void StaticXmlProvider::loadPayloadLink(const KNS3::EntryInternal &entry, int)
 EntryInternal::List StaticXmlProvider::installedEntries() const
 {
     EntryInternal::List entries;
-    foreach (const EntryInternal &entry, mCachedEntries) {
+    foreach (const EntryInternal &entry, mCachedEntries.entries()) {
         if (entry.status() == Entry::Installed || entry.status() == Entry::Updateable) {
             entries.append(entry);
         }
@@ -20,7 +20,11 @@
 #ifndef KNEWSTUFF3_STATICXMLPROVIDER_P_H
 #define KNEWSTUFF3_STATICXMLPROVIDER_P_H
 
+#include "core/entrystore_p.h"
 #include "core/provider_p.h"
+#include "core/searchindex_p.h"
+#include <QElapsedTimer>
+#include <QHash>
 #include <QMap>
 
 namespace KNS3
@@ -61,16 +65,51 @@ public:
     void setCachedEntries(const KNS3::EntryInternal::List &cachedEntries) Q_DECL_OVERRIDE;
 
     void loadEntries(const KNS3::Provider::SearchRequest &request) Q_DECL_OVERRIDE;
+    void abortRequest(const KNS3::Provider::SearchRequest &request) Q_DECL_OVERRIDE;
     void loadPayloadLink(const KNS3::EntryInternal &entry, int) Q_DECL_OVERRIDE;
 
+    /// Use downloaded feeds for @p seconds without asking the server whether they changed
+    void setFeedMaxAge(int seconds);
+
 private Q_SLOTS:
     void slotEmitProviderInitialized();
+    void slotFeedEntriesLoaded(const KNS3::EntryInternal::List &parsed);
     void slotFeedFileLoaded(const QDomDocument &);
     void slotFeedFailed();
+    void slotDeltaLoaded(const QDomDocument &);
+    void slotDeltaFailed();
+    void slotUpdateManifestLoaded(const QDomDocument &);
+    void slotUpdateManifestFailed();
+    void slotUpdateEntryLoaded(const QDomDocument &);
+    void slotUpdateEntryFailed();
 
 private:
-    bool searchIncludesEntry(const EntryInternal &entry) const;
-    QUrl downloadUrl(SortMode mode) const;
+    // download the feed at @p url, the request is answered once it is loaded
+    void loadFeed(const KNS3::Provider::SearchRequest &request, const QUrl &url);
+    // bring the catalog up to date, with a delta feed if the provider has a downloadurl-delta
+    void refreshCatalog(const KNS3::Provider::SearchRequest &request);
+    // answer the update checks once all changed entries are loaded
+    void finishUpdateCheck();
+    // continue the requests that waited for a feed
+    void continueRequests(const QList<Provider::SearchRequest> &requests);
+    // the changes to the catalog since mGeneration
+    QUrl deltaUrl() const;
+    // replace the catalog, entries that are not in @p catalog anymore leave the search index
+    void setCatalog(const EntryInternal::List &catalog);
+    // answer the request from the catalog: filter, sort and cut out the page
+    void answerRequest(const KNS3::Provider::SearchRequest &request);
+    // the feed that holds all entries
+    QUrl catalogUrl() const;
+    // the feed the server sorted by @p mode, empty if there is none besides the catalog
+    QUrl sortFeedUrl(SortMode mode) const;
+    // whether the catalog has the data to sort by @p mode itself
+    bool hasSortData(SortMode mode) const;
+    // take the status of a parsed feed entry from the cached entries,
+    // relative payload and preview urls are resolved against the document the entry is from at @p documentUrl
+    EntryInternal feedEntry(EntryInternal entry, const QUrl &documentUrl);
+    bool searchIncludesEntry(const Provider::SearchRequest &request, const EntryInternal &entry) const;
+    // the entries of @p entries that match @p request, in their order
+    EntryInternal::List matchingEntries(const Provider::SearchRequest &request, const EntryInternal::List &entries) const;
     EntryInternal::List installedEntries() const;
 
     // map of download urls to their feed name
@@ -79,11 +118,44 @@ private:
     QUrl mNoUploadUrl;
 
     // cache of all entries known from this provider so far, mapped by their id
-    EntryInternal::List mCachedEntries;
-    QMap<Provider::SortMode, XmlLoader *> mFeedLoaders;
-    Provider::SearchRequest mCurrentRequest;
+    EntryStore mCachedEntries;
+    // finds the cached entries that contain a search term
+    SearchIndex mSearchIndex;
+    // the requests each running feed loader answers
+    QHash<XmlLoader *, QList<Provider::SearchRequest> > mFeedLoaders;
+    // the running feed loader for each feed url
+    QHash<QUrl, XmlLoader *> mFeedLoadersByUrl;
+    // the entries each running feed loader parsed so far
+    QHash<XmlLoader *, EntryInternal::List> mFeedEntries;
+    // entries shown early for requests that wait for a feed
+    QHash<Provider::SearchRequest, int> mProgressSent;
+
+    // the entries of the catalog feed in feed order, all requests are answered from it
+    EntryInternal::List mCatalog;
+    // time since the catalog was loaded, invalid before
+    QElapsedTimer mCatalogAge;
+    // sort mode -> unique id -> position in the feed the server sorted, for sort modes the catalog lacks data for
+    QHash<int, QHash<QString, int> > mFeedOrder;
+    // version of the catalog as given by the server, empty if it does not offer delta feeds
+    QString mGeneration;
+    // template for the delta feed url, {since} is replaced by the generation (optional)
+    QString mDeltaUrlTemplate;
+    XmlLoader *mDeltaLoader;
+    // the requests waiting for the delta feed
+    QList<Provider::SearchRequest> mDeltaRequests;
+
+    // compact list of the current version of each entry, for fast update checks (optional)
+    QUrl mUpdateManifestUrl;
+    XmlLoader *mUpdateManifestLoader;
+    // the update checks waiting for the manifest
+    QList<Provider::SearchRequest> mUpdateRequests;
+    // the loaders of the entries the manifest reported as changed
+    QList<XmlLoader *> mUpdateEntryLoaders;
+    // the update checks waiting for the changed entries
+    QList<Provider::SearchRequest> mUpdateEntryRequests;
     QString mId;
     bool mInitialized;
+    int mFeedMaxAge;
 
     Q_DISABLE_COPY(StaticXmlProvider)
 };
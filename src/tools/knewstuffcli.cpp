@@ -0,0 +1,397 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * knewstuff-cli: search, install, update and uninstall content of a .knsrc file
+ * without user interaction, for scripts and provisioning.
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSet>
+#include <QTextStream>
+#include <QTimer>
+
+#include "downloadmanager.h"
+#include "entry.h"
+
+#include <cstdio>
+
+// entries asked for when paging through a provider looking for ids
+static const int PageSize = 100;
+// how long (s) looking up entries and each installation may take by default
+static const int DefaultTimeout = 300;
+
+static QString statusName(KNS3::Entry::Status status)
+{
+    switch (status) {
+    case KNS3::Entry::Invalid:
+        return QStringLiteral("invalid");
+    case KNS3::Entry::Downloadable:
+        return QStringLiteral("downloadable");
+    case KNS3::Entry::Installed:
+        return QStringLiteral("installed");
+    case KNS3::Entry::Updateable:
+        return QStringLiteral("updateable");
+    case KNS3::Entry::Deleted:
+        return QStringLiteral("deleted");
+    case KNS3::Entry::Installing:
+        return QStringLiteral("installing");
+    case KNS3::Entry::Updating:
+        return QStringLiteral("updating");
+    }
+    return QString();
+}
+
+class Cli : public QObject
+{
+    Q_OBJECT
+public:
+    Cli(const QString &configFile, const QString &command, const QStringList &arguments, bool all, bool json, int timeout)
+        : m_manager(new KNS3::DownloadManager(configFile, this))
+        , m_command(command)
+        , m_arguments(arguments)
+        , m_all(all)
+        , m_json(json)
+        , m_timeout(timeout * 1000)
+        , m_page(0)
+        , m_exitCode(0)
+        , m_finished(false)
+    {
+        m_manager->setInteractive(false);
+        m_lookupTimer.setSingleShot(true);
+        m_lookupTimer.setInterval(m_timeout);
+        connect(&m_lookupTimer, &QTimer::timeout, this, &Cli::lookupTimedOut);
+        connect(m_manager, &KNS3::DownloadManager::errorFound, this, &Cli::error);
+        connect(m_manager, &KNS3::DownloadManager::entryStatusChanged, this, &Cli::entryStatusChanged);
+    }
+
+    bool start()
+    {
+        // the providers are asked first, the time starts again for each page
+        m_lookupTimer.start();
+        if (m_command == QLatin1String("search")) {
+            // setting the term shows what is known locally right away, only the search itself counts
+            m_manager->setSearchTerm(m_arguments.join(QLatin1Char(' ')));
+            connect(m_manager, &KNS3::DownloadManager::searchResult, this, &Cli::listAndQuit);
+            m_manager->search(0, PageSize);
+        } else if (m_command == QLatin1String("list-installed")) {
+            connect(m_manager, &KNS3::DownloadManager::searchResult, this, &Cli::listAndQuit);
+            m_manager->checkForInstalled();
+        } else if (m_command == QLatin1String("install") && !m_arguments.isEmpty()) {
+            m_wanted = m_arguments.toSet();
+            connect(m_manager, &KNS3::DownloadManager::searchResult, this, &Cli::searchPageLoaded);
+            m_manager->search(m_page, PageSize);
+        } else if (m_command == QLatin1String("update") && m_all == m_arguments.isEmpty()) {
+            m_wanted = m_arguments.toSet();
+            connect(m_manager, &KNS3::DownloadManager::searchResult, this, &Cli::updatesLoaded);
+            connect(m_manager, &KNS3::DownloadManager::updateCheckFinished, this, &Cli::updateCheckFinished);
+            m_manager->checkForUpdates();
+        } else if (m_command == QLatin1String("uninstall") && !m_arguments.isEmpty()) {
+            m_wanted = m_arguments.toSet();
+            connect(m_manager, &KNS3::DownloadManager::searchResult, this, &Cli::installedLoaded);
+            m_manager->checkForInstalled();
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    int exitCode() const
+    {
+        return m_exitCode;
+    }
+
+private Q_SLOTS:
+    void error(const QString &message)
+    {
+        QTextStream(stderr) << "error: " << message << endl;
+    }
+
+    void listAndQuit(const KNS3::Entry::List &entries)
+    {
+        m_lookupTimer.stop();
+        if (m_json) {
+            QJsonArray array;
+            foreach (const KNS3::Entry &entry, entries) {
+                array.append(entryToJson(entry));
+            }
+            QTextStream(stdout) << QJsonDocument(array).toJson();
+        } else {
+            QTextStream out(stdout);
+            foreach (const KNS3::Entry &entry, entries) {
+                out << entry.id() << '\t' << entry.name() << '\t' << entry.version() << '\t' << statusName(entry.status()) << endl;
+            }
+        }
+        QCoreApplication::exit(m_exitCode);
+    }
+
+    // install: page through the catalog until all requested ids are found
+    void searchPageLoaded(const KNS3::Entry::List &entries)
+    {
+        foreach (const KNS3::Entry &entry, entries) {
+            if (m_wanted.remove(entry.id())) {
+                m_found.append(entry);
+            }
+        }
+        if (!m_wanted.isEmpty() && entries.size() >= PageSize) {
+            m_lookupTimer.start();
+            m_manager->search(++m_page, PageSize);
+            return;
+        }
+        m_lookupTimer.stop();
+        disconnect(m_manager, &KNS3::DownloadManager::searchResult, this, &Cli::searchPageLoaded);
+        reportMissing();
+        installFound();
+    }
+
+    // update: collect the answers of all providers
+    void updatesLoaded(const KNS3::Entry::List &entries)
+    {
+        foreach (const KNS3::Entry &entry, entries) {
+            if (m_all || m_wanted.contains(entry.id())) {
+                m_found.append(entry);
+            }
+        }
+    }
+
+    void updateCheckFinished()
+    {
+        m_lookupTimer.stop();
+        disconnect(m_manager, &KNS3::DownloadManager::searchResult, this, &Cli::updatesLoaded);
+        disconnect(m_manager, &KNS3::DownloadManager::updateCheckFinished, this, &Cli::updateCheckFinished);
+        foreach (const KNS3::Entry &entry, m_found) {
+            m_wanted.remove(entry.id());
+        }
+        reportMissing();
+        installFound();
+    }
+
+    void installedLoaded(const KNS3::Entry::List &entries)
+    {
+        m_lookupTimer.stop();
+        disconnect(m_manager, &KNS3::DownloadManager::searchResult, this, &Cli::installedLoaded);
+        foreach (const KNS3::Entry &entry, entries) {
+            if (m_wanted.remove(entry.id())) {
+                m_found.append(entry);
+            }
+        }
+        reportMissing();
+        // uninstalling finishes right away, all operations have to be pending before the first one ends
+        foreach (const KNS3::Entry &entry, m_found) {
+            startOperation(entry);
+        }
+        foreach (const KNS3::Entry &entry, m_found) {
+            m_manager->uninstallEntry(entry);
+        }
+        finishIfDone();
+    }
+
+    void lookupTimedOut()
+    {
+        // whatever the providers send from now on is too late
+        disconnect(m_manager, &KNS3::DownloadManager::searchResult, this, 0);
+        disconnect(m_manager, &KNS3::DownloadManager::updateCheckFinished, this, 0);
+        error(QStringLiteral("the providers did not answer in time"));
+        foreach (const QString &id, m_wanted) {
+            report(id, QString(), QStringLiteral("timed out"));
+        }
+        m_wanted.clear();
+        m_exitCode = 1;
+        finishIfDone();
+    }
+
+    void entryStatusChanged(const KNS3::Entry &entry)
+    {
+        if (!m_pending.contains(entry.id())) {
+            return;
+        }
+        QString result;
+        switch (entry.status()) {
+        case KNS3::Entry::Installing:
+        case KNS3::Entry::Updating:
+            return;
+        case KNS3::Entry::Installed:
+            result = QStringLiteral("installed");
+            break;
+        case KNS3::Entry::Deleted:
+            result = QStringLiteral("uninstalled");
+            break;
+        default:
+            // the installation failed and the entry went back to its former state
+            result = QStringLiteral("failed");
+            m_exitCode = 1;
+            break;
+        }
+        delete m_pending.take(entry.id());
+        report(entry.id(), entry.name(), result);
+        finishIfDone();
+    }
+
+private:
+    // each installation and uninstallation gets its own time limit
+    void startOperation(const KNS3::Entry &entry)
+    {
+        const QString id = entry.id();
+        const QString name = entry.name();
+        QTimer *timer = new QTimer(this);
+        timer->setSingleShot(true);
+        connect(timer, &QTimer::timeout, this, [this, id, name]() {
+            // the engine may still finish it, that is not reported anymore
+            m_pending.take(id)->deleteLater();
+            report(id, name, QStringLiteral("timed out"));
+            m_exitCode = 1;
+            finishIfDone();
+        });
+        timer->start(m_timeout);
+        delete m_pending.take(id);
+        m_pending.insert(id, timer);
+    }
+
+    void installFound()
+    {
+        // the engine runs the installations in parallel, limited by its job scheduler;
+        // installations from local mirrors finish within installEntry()
+        foreach (const KNS3::Entry &entry, m_found) {
+            startOperation(entry);
+        }
+        foreach (const KNS3::Entry &entry, m_found) {
+            m_manager->installEntry(entry);
+        }
+        finishIfDone();
+    }
+
+    void reportMissing()
+    {
+        foreach (const QString &id, m_wanted) {
+            report(id, QString(), QStringLiteral("not found"));
+            m_exitCode = 1;
+        }
+        m_wanted.clear();
+    }
+
+    void report(const QString &id, const QString &name, const QString &result)
+    {
+        if (m_json) {
+            QJsonObject object;
+            object.insert(QStringLiteral("id"), id);
+            object.insert(QStringLiteral("name"), name);
+            object.insert(QStringLiteral("result"), result);
+            m_results.append(object);
+        } else {
+            QTextStream(stdout) << id << '\t' << name << '\t' << result << endl;
+        }
+    }
+
+    // called whenever an operation ended, the results are written once when the last one did
+    void finishIfDone()
+    {
+        if (!m_pending.isEmpty() || m_finished) {
+            return;
+        }
+        m_finished = true;
+        if (m_json) {
+            QTextStream(stdout) << QJsonDocument(m_results).toJson();
+        }
+        // leave the event loop after the engine processed the last change
+        QTimer::singleShot(0, this, [this]() {
+            QCoreApplication::exit(m_exitCode);
+        });
+    }
+
+    static QJsonObject entryToJson(const KNS3::Entry &entry)
+    {
+        QJsonObject object;
+        object.insert(QStringLiteral("id"), entry.id());
+        object.insert(QStringLiteral("providerId"), entry.providerId());
+        object.insert(QStringLiteral("name"), entry.name());
+        object.insert(QStringLiteral("category"), entry.category());
+        object.insert(QStringLiteral("version"), entry.version());
+        object.insert(QStringLiteral("updateVersion"), entry.updateVersion());
+        object.insert(QStringLiteral("status"), statusName(entry.status()));
+        object.insert(QStringLiteral("summary"), entry.summary());
+        object.insert(QStringLiteral("installedFiles"), QJsonArray::fromStringList(entry.installedFiles()));
+        return object;
+    }
+
+    KNS3::DownloadManager *m_manager;
+    QString m_command;
+    QStringList m_arguments;
+    // update everything that has an update
+    bool m_all;
+    bool m_json;
+    // how long (ms) looking up the entries and each operation may take
+    int m_timeout;
+
+    // ids asked for that have not been found yet
+    QSet<QString> m_wanted;
+    KNS3::Entry::List m_found;
+    // ids being installed or uninstalled, with the timer of their time limit
+    QHash<QString, QTimer *> m_pending;
+    int m_page;
+    // time limit for the providers to answer
+    QTimer m_lookupTimer;
+    QJsonArray m_results;
+    int m_exitCode;
+    bool m_finished;
+};
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("knewstuff-cli"));
+    QCoreApplication::setOrganizationDomain(QStringLiteral("kde.org"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Manage the content of a KNewStuff configuration without user interaction."));
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption(QStringLiteral("json"), QStringLiteral("Print the results as JSON.")));
+    parser.addOption(QCommandLineOption(QStringLiteral("all"), QStringLiteral("Update all entries that have an update.")));
+    parser.addOption(QCommandLineOption(QStringLiteral("timeout"),
+                                        QStringLiteral("Give up on looking up the entries and on each installation after this many seconds."),
+                                        QStringLiteral("seconds"), QString::number(DefaultTimeout)));
+    parser.addPositionalArgument(QStringLiteral("knsrc"), QStringLiteral("The .knsrc file, for example plasmoids.knsrc"));
+    parser.addPositionalArgument(QStringLiteral("command"),
+                                 QStringLiteral("search [term] | list-installed | install <id>... | update --all | update <id>... | uninstall <id>..."));
+    parser.process(app);
+
+    bool validTimeout = false;
+    const int timeout = parser.value(QStringLiteral("timeout")).toInt(&validTimeout);
+    if (!validTimeout || timeout <= 0) {
+        parser.showHelp(1);
+    }
+
+    QStringList arguments = parser.positionalArguments();
+    if (arguments.size() < 2) {
+        parser.showHelp(1);
+    }
+    const QString configFile = arguments.takeFirst();
+    const QString command = arguments.takeFirst();
+
+    Cli cli(configFile, command, arguments, parser.isSet(QStringLiteral("all")), parser.isSet(QStringLiteral("json")), timeout);
+    if (!cli.start()) {
+        parser.showHelp(1);
+    }
+    app.exec();
+    return cli.exitCode();
+}
+
+#include "knewstuffcli.moc"
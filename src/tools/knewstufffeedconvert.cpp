@@ -0,0 +1,134 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * knewstuff-feedconvert: convert the XML feed of a static provider into the
+ * binary feed format, which is loaded without building a document tree.
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QSaveFile>
+#include <QTextStream>
+
+#include "core/feedparser_p.h"
+#include "core/xmlloader_p.h"
+
+#include <cstdio>
+
+class Converter : public QObject
+{
+    Q_OBJECT
+public:
+    Converter(const QUrl &source, const QString &target)
+        : m_loader(new KNS3::XmlLoader(this))
+        , m_source(source)
+        , m_target(target)
+        , m_count(0)
+        , m_exitCode(0)
+    {
+        // the feed is parsed on worker threads while it is read, like in the provider
+        m_loader->setStreaming(true);
+        connect(m_loader, &KNS3::XmlLoader::signalEntriesLoaded, this, &Converter::entriesLoaded);
+        connect(m_loader, &KNS3::XmlLoader::signalLoaded, this, &Converter::loaded);
+        connect(m_loader, &KNS3::XmlLoader::signalFailed, this, &Converter::failed);
+    }
+
+    bool start()
+    {
+        if (!m_target.open(QIODevice::WriteOnly)) {
+            QTextStream(stderr) << "Cannot write " << m_target.fileName() << ": " << m_target.errorString() << endl;
+            return false;
+        }
+        m_loader->load(m_source);
+        return true;
+    }
+
+    int exitCode() const
+    {
+        return m_exitCode;
+    }
+
+private Q_SLOTS:
+    void entriesLoaded(const KNS3::EntryInternal::List &entries)
+    {
+        foreach (const KNS3::EntryInternal &entry, entries) {
+            m_records.append(KNS3::FeedParser::binaryRecord(entry));
+            ++m_count;
+        }
+    }
+
+    void loaded(const QDomDocument &doc)
+    {
+        // the generation is only known at the end, it goes in front of the records
+        m_target.write(KNS3::FeedParser::binaryHeader(doc.documentElement().attribute(QStringLiteral("generation"))));
+        m_target.write(m_records);
+        m_target.write(KNS3::FeedParser::binaryEnd());
+        if (!m_target.commit()) {
+            QTextStream(stderr) << "Cannot write " << m_target.fileName() << ": " << m_target.errorString() << endl;
+            m_exitCode = 1;
+        } else {
+            QTextStream(stdout) << "Converted " << m_count << " entries" << endl;
+        }
+        qApp->quit();
+    }
+
+    void failed()
+    {
+        QTextStream(stderr) << "Cannot load " << m_source.toDisplayString() << endl;
+        m_target.cancelWriting();
+        m_exitCode = 1;
+        qApp->quit();
+    }
+
+private:
+    KNS3::XmlLoader *m_loader;
+    QUrl m_source;
+    QSaveFile m_target;
+    QByteArray m_records;
+    int m_count;
+    int m_exitCode;
+};
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("knewstuff-feedconvert"));
+    QCoreApplication::setOrganizationDomain(QStringLiteral("kde.org"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Convert the XML feed of a static provider into the binary feed format."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("feed"), QStringLiteral("The XML feed, a file or URL, may be compressed"));
+    parser.addPositionalArgument(QStringLiteral("output"), QStringLiteral("The binary feed to write, for example feed.knsfeed"));
+    parser.process(app);
+
+    const QStringList arguments = parser.positionalArguments();
+    if (arguments.size() != 2) {
+        parser.showHelp(1);
+    }
+
+    Converter converter(QUrl::fromUserInput(arguments.at(0), QDir::currentPath(), QUrl::AssumeLocalFile), arguments.at(1));
+    if (!converter.start()) {
+        return 1;
+    }
+    app.exec();
+    return converter.exitCode();
+}
+
+#include "knewstufffeedconvert.moc"
@@ -0,0 +1,163 @@
+/*
+    Copyright (C) 2016 KNewStuff authors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * knewstuff-indexdir: write the index of a directory of payloads, for
+ * providers of type "directory" on local mirrors.
+ *
+ * Every file becomes an entry. Its metadata is taken from a <file>.stuff.xml
+ * next to it (a <stuff> element as in a feed) if there is one, otherwise it is
+ * made up from the file: its name, and a version and release date from the
+ * time it was last modified. The payload always points at the file.
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QSaveFile>
+#include <QTextStream>
+
+#include "core/entryinternal_p.h"
+#include "core/feedparser_p.h"
+
+#include <algorithm>
+#include <cstdio>
+
+static const char MetadataSuffix[] = ".stuff.xml";
+
+static KNS3::EntryInternal entryForFile(const QDir &directory, const QFileInfo &file)
+{
+    const QString relativePath = directory.relativeFilePath(file.filePath());
+    KNS3::EntryInternal entry;
+
+    QFile metadata(file.filePath() + QLatin1String(MetadataSuffix));
+    if (metadata.open(QIODevice::ReadOnly)) {
+        QDomDocument doc;
+        QString errorMessage;
+        if (doc.setContent(&metadata, &errorMessage)) {
+            // without a payload it is not valid yet
+            entry.setEntryXML(doc.documentElement());
+            if (doc.documentElement().firstChildElement(QStringLiteral("id")).isNull()) {
+                // setEntryXML() made one up from the name
+                entry.setUniqueId(QString());
+            }
+            // previews are given relative to the metadata file, the index may be in another directory
+            const QString subdirectory = directory.relativeFilePath(file.path());
+            const QUrl fileDirectory(QString::fromLatin1(QUrl::toPercentEncoding(subdirectory + QLatin1Char('/'), "/")));
+            for (int i = 0; i < 6 && !subdirectory.isEmpty() && subdirectory != QLatin1String("."); ++i) {
+                const KNS3::EntryInternal::PreviewType type = KNS3::EntryInternal::PreviewType(i);
+                const QUrl preview(entry.previewUrl(type));
+                if (preview.isRelative() && !entry.previewUrl(type).isEmpty()) {
+                    entry.setPreviewUrl(fileDirectory.resolved(preview).toString(), type);
+                }
+            }
+        } else {
+            QTextStream(stderr) << "Ignoring " << metadata.fileName() << ": " << errorMessage << endl;
+        }
+    }
+
+    const QDateTime modified = file.lastModified().toUTC();
+    if (entry.uniqueId().isEmpty()) {
+        entry.setUniqueId(relativePath);
+    }
+    if (entry.name().isEmpty()) {
+        entry.setName(file.completeBaseName());
+    }
+    if (entry.version().isEmpty()) {
+        entry.setVersion(modified.toString(QStringLiteral("yyyyMMdd.hhmmss")));
+    }
+    if (!entry.releaseDate().isValid()) {
+        entry.setReleaseDate(modified.date());
+    }
+    // relative to the index, the provider resolves it
+    entry.setPayload(QString::fromLatin1(QUrl::toPercentEncoding(relativePath, "/")));
+    return entry;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("knewstuff-indexdir"));
+    QCoreApplication::setOrganizationDomain(QStringLiteral("kde.org"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Write the index of a directory of payloads for a KNewStuff provider of type \"directory\"."));
+    parser.addHelpOption();
+    QCommandLineOption indexOption(QStringLiteral("index"), QStringLiteral("Name of the index file in the directory."),
+                                   QStringLiteral("file"), QStringLiteral("index.knsfeed"));
+    parser.addOption(indexOption);
+    parser.addOption(QCommandLineOption(QStringLiteral("xml"), QStringLiteral("Write an XML feed instead of a binary one.")));
+    parser.addPositionalArgument(QStringLiteral("directory"), QStringLiteral("The directory of payloads"));
+    parser.process(app);
+
+    const QStringList arguments = parser.positionalArguments();
+    if (arguments.size() != 1) {
+        parser.showHelp(1);
+    }
+    const QDir directory(arguments.first());
+    if (!directory.exists()) {
+        QTextStream(stderr) << "No such directory: " << directory.path() << endl;
+        return 1;
+    }
+    const QString indexName = parser.value(indexOption);
+    const bool xml = parser.isSet(QStringLiteral("xml"));
+
+    KNS3::EntryInternal::List entries;
+    QDirIterator it(directory.path(), QDir::Files | QDir::Readable, QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
+    while (it.hasNext()) {
+        const QFileInfo file(it.next());
+        if (file.fileName().endsWith(QLatin1String(MetadataSuffix)) || directory.relativeFilePath(file.filePath()) == indexName) {
+            continue;
+        }
+        entries.append(entryForFile(directory, file));
+    }
+    // the same order for the same directory
+    std::sort(entries.begin(), entries.end(), [](const KNS3::EntryInternal &left, const KNS3::EntryInternal &right) {
+        return left.payload() < right.payload();
+    });
+
+    QSaveFile index(directory.filePath(indexName));
+    if (!index.open(QIODevice::WriteOnly)) {
+        QTextStream(stderr) << "Cannot write " << index.fileName() << ": " << index.errorString() << endl;
+        return 1;
+    }
+    if (xml) {
+        QDomDocument doc;
+        QDomElement root = doc.createElement(QStringLiteral("knewstuff"));
+        doc.appendChild(root);
+        foreach (KNS3::EntryInternal entry, entries) {
+            // entryXML() needs one, the provider sets its own
+            entry.setProviderId(indexName);
+            root.appendChild(doc.importNode(entry.entryXML(), true));
+        }
+        index.write(doc.toByteArray());
+    } else {
+        index.write(KNS3::FeedParser::binaryHeader(QString()));
+        foreach (const KNS3::EntryInternal &entry, entries) {
+            index.write(KNS3::FeedParser::binaryRecord(entry));
+        }
+        index.write(KNS3::FeedParser::binaryEnd());
+    }
+    if (!index.commit()) {
+        QTextStream(stderr) << "Cannot write " << index.fileName() << ": " << index.errorString() << endl;
+        return 1;
+    }
+    QTextStream(stdout) << "Indexed " << entries.size() << " entries in " << index.fileName() << endl;
+    return 0;
+}
@@ -29,6 +29,7 @@ ImageLoader::ImageLoader(const EntryInternal &entry, EntryInternal::PreviewType
     : QObject(parent)
     , m_entry(entry)
     , m_previewType(type)
+    , m_job(0)
 {
 }
 
@@ -40,9 +41,21 @@ void ImageLoader::start()
         connect(m_job, &KJob::result, this, &ImageLoader::slotDownload);
         connect(m_job, &KIO::TransferJob::data, this, &ImageLoader::slotData);
         KIO::Scheduler::setJobPriority(m_job, 1);
+    } else {
+        emit signalError(m_entry, m_previewType, QStringLiteral("Empty url"));
+        deleteLater();
     }
 }
 
+void ImageLoader::abort()
+{
+    if (m_job) {
+        m_job->kill();
+        m_job = 0;
+    }
+    deleteLater();
+}
+
 KJob *ImageLoader::job()
 {
     return m_job;
@@ -58,6 +71,8 @@ void ImageLoader::slotDownload(KJob *job)
 {
     if (job->error()) {
         m_buffer.clear();
+        emit signalError(m_entry, m_previewType, job->errorString());
+        deleteLater();
         return;
     }
     QImage image;
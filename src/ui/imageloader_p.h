@@ -53,6 +53,10 @@ class ImageLoader : public QObject
 public:
     ImageLoader(const EntryInternal &entry, EntryInternal::PreviewType type, QObject *parent);
     void start();
+    /**
+     * Stop loading and delete the loader, no signal is emitted.
+     */
+    void abort();
     /**
      * Get the job doing the image loading in the background (to have progress information available)
      * @return the job
@@ -61,6 +65,7 @@ public:
 
 Q_SIGNALS:
     void signalPreviewLoaded(const KNS3::EntryInternal &, KNS3::EntryInternal::PreviewType);
+    void signalError(const KNS3::EntryInternal &, KNS3::EntryInternal::PreviewType, const QString &);
 
 private Q_SLOTS:
     void slotDownload(KJob *job);